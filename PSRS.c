@@ -2,6 +2,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "sort_stats.h"
+#include "sort_bench.h"
+#include "gen_keys.h"
+#include "sort_verify.h"
+#include "sort_service.h"
+#include "sort_merge.h"
+#include "node_shm.h"
+#include "sort_adapt.h"
+#include "sort_arena.h"
 
 #define MASTER 0        /* task id of master task */
 #define MAXNUMBER 500   /* maximum number for random array generation */
@@ -11,106 +22,441 @@ void swap(int* a, int* b);
 int partition(int arr[], int low, int high);
 void quickSort(int arr[], int low, int high);
 void printArray(int arr[], int size, bool demo_mode);
-int* create_array(int size);
+void local_sort(int arr[], int size, const char *kernel, sort_arena *arena);
+int *psrs_sort(int *local_array, int local_size, int *sorted_size, int taskid, int numtasks,
+               const char *kernel, node_shm *shm, sort_arena *arena, sort_stats *stats);
+int *auto_sort(int *local_array, int local_size, int *sorted_size, int taskid, int numtasks,
+               node_shm *shm, sort_arena *arena, sort_stats *stats, adapt_profile *profile, adapt_decision *plan);
+bool psrs_reserve(sort_arena *arena, long long n, int numtasks, const char *kernel, const node_shm *shm);
+bool valid_opts(const sort_opts *opts);
+int run_job(sort_opts *opts, void *context, char *result, size_t result_size);
+
+// What run_job needs besides its options, kept across service jobs
+typedef struct {
+    int taskid, numtasks;
+    node_shm *shm;
+    sort_arena *arena;
+} job_context;
 
 // Main function
 int main(int argc, char *argv[])
 {
     int taskid, numtasks;
-    bool demo_mode = false;
-    
-    int data_size = 150; // Size of data to sort
     
-    // Generate the random array
-    int* random_array_seq = create_array(data_size);
+    // Defaults: 150 random keys in [0, MAXNUMBER]
+    sort_opts opts = {0};
+    opts.n = 150;
+    opts.dist = DIST_UNIFORM;
+    opts.max_value = MAXNUMBER;
+    opts.skew = 1.0;
+    opts.seed = 1;
+    opts.kernel = "quick";
+    opts.repeat = 1;
     
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
     
-    // Local array for each process
-    int local_size = (data_size + numtasks - 1) / numtasks; // Calculate ceiling of data_size / numtasks
-    int *local_array = (int *)malloc(local_size * sizeof(int));
-    
-    // Scatter data across processes
-    MPI_Scatter(random_array_seq, local_size, MPI_INT, local_array, local_size, MPI_INT, MASTER, MPI_COMM_WORLD);
+    if (!parse_sort_opts(argc, argv, &opts, taskid == MASTER) || !valid_opts(&opts)) {
+        if (taskid == MASTER) {
+            fprintf(stderr, "Usage: psrs [--n N --dist D --max M --skew Z --seed S | --shards PREFIX]\n"
+                            "            [--kernel quick|qsort|runs|count|auto] [--warmup W] [--repeat R] [--quiet] [--stats FILE]\n"
+                            "            [--shm] [--huge-pages] [--arena-limit MB] [--serve SOCKET]\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    // Kept for the whole run so --shm sorts reuse the node's shared window
+    node_shm shm;
+    node_shm_init(&shm, MPI_COMM_WORLD);
+
+    // Sort buffers are kept for the whole run as well, across repeats and jobs
+    sort_arena arena;
+    arena_init(&arena, opts.huge_pages);
+
+    job_context context = { taskid, numtasks, &shm, &arena };
+    int status = 0;
+    if (opts.serve != NULL) {
+        service_run(&opts, "psrs", valid_opts, run_job, &context, MPI_COMM_WORLD);
+    } else {
+        char result[256];
+        status = run_job(&opts, &context, result, sizeof(result));
+        if (status == 0 && taskid == MASTER) {
+            printf("%s\n", result);
+        }
+    }
+
+    arena_free(&arena);
+    node_shm_free(&shm);
+    MPI_Finalize();
+    return status;
+}
+
+bool valid_opts(const sort_opts *opts)
+{
+    return opts->n >= 1 && valid_kernel(opts->kernel, "quick");
+}
+
+/*
+    Read (or generate) the input, sort it opts->warmup + opts->repeat times
+    and verify the result. context is the job_context. MASTER gets the
+    RESULT line in result. Returns non-zero on every rank if any rank failed
+    to read its input.
+*/
+int run_job(sort_opts *opts, void *context, char *result, size_t result_size)
+{
+    job_context *ctx = (job_context *)context;
+    int taskid = ctx->taskid, numtasks = ctx->numtasks;
+    node_shm *shm = ctx->shm;
+    sort_arena *arena = ctx->arena;
+    bool demo_mode = false;
+    sort_stats stats;
+    int data_size; // Size of data to sort
+
+    // Every rank generates (or loads) its own block of the input directly
+    int local_size = 0;
+    double read_time = MPI_Wtime();
+    int *local_input = load_keys(opts, MPI_COMM_WORLD, &local_size, &data_size);
+    read_time = MPI_Wtime() - read_time;
+    if (local_input == NULL) {
+        return 1;
+    }
+    opts->n = data_size;
+
+    key_digest input_digest = {0, 0, 0, 0};
+    digest_keys(&input_digest, local_input, local_size);
+
+    // Size the arena up front so the runs below reuse its buffers; a job
+    // that does not fit fails on every rank, like one that cannot be read
+    arena_configure(arena, opts->huge_pages, (size_t)opts->arena_limit << 20);
+    int reserved = psrs_reserve(arena, data_size, numtasks, opts->kernel, opts->shm ? shm : NULL), all_reserved;
+    MPI_Allreduce(&reserved, &all_reserved, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_reserved) {
+        if (taskid == MASTER) {
+            fprintf(stderr, "Sort buffers do not fit in memory or under --arena-limit\n");
+        }
+        free(local_input);
+        return 1;
+    }
+
+    // Warm-up runs first, then the timed ones; stats cover the last run
+    int *sorted = NULL;
+    int sorted_size = 0;
+    double *times = (double *)malloc(opts->repeat * sizeof(double));
+    bool adaptive = strcmp(opts->kernel, "auto") == 0;
+    adapt_profile profile;
+    adapt_decision plan;
+    for (int run = -opts->warmup; run < opts->repeat; run++) {
+        stats_reset(&stats);
+
+        // With --shm the slice is sorted inside this rank's shared segment
+        int *work;
+        if (opts->shm) {
+            node_shm_reserve(shm, local_size);
+            work = node_shm_local(shm);
+        } else {
+            work = (int *)arena_get(arena, ARENA_KEYS, (local_size + 1) * sizeof(int));
+        }
+        memcpy(work, local_input, local_size * sizeof(int));
+        MPI_Barrier(MPI_COMM_WORLD);
+        double start = MPI_Wtime();
+        if (adaptive) {
+            sorted = auto_sort(work, local_size, &sorted_size, taskid, numtasks,
+                               opts->shm ? shm : NULL, arena, &stats, &profile, &plan);
+        } else {
+            sorted = psrs_sort(work, local_size, &sorted_size, taskid, numtasks, opts->kernel,
+                               opts->shm ? shm : NULL, arena, &stats);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        if (run >= 0) {
+            times[run] = MPI_Wtime() - start;
+        }
+
+        // A buffer that could not grow during the sort fails the job on every rank
+        int sort_ok = sorted != NULL, all_sort_ok;
+        MPI_Allreduce(&sort_ok, &all_sort_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (!all_sort_ok) {
+            if (taskid == MASTER) {
+                fprintf(stderr, "Sort buffers outgrew memory or --arena-limit during the sort\n");
+            }
+            free(times);
+            free(local_input);
+            return 1;
+        }
+    }
+    stats.time[PHASE_READ] = read_time;
+    stats.arena_bytes = (double)arena_bytes(arena);
+    stats.arena_peak = (double)arena->peak;
+    stats.arena_limit = (double)arena->limit;
+    if (adaptive) {
+        adapt_log(&profile, plan, "psrs", taskid);
+    }
+
+    stats_start(&stats, PHASE_VERIFY);
+    bool verified = verify_sorted(&input_digest, sorted, sorted_size, MPI_COMM_WORLD);
+    stats_stop(&stats);
+
+    // Gather sorted data at the master process
+    int *final_sorted = NULL;
+    if (!opts->quiet) {
+        stats_start(&stats, PHASE_GATHER);
+        if (taskid != MASTER) {
+            stats_sent(&stats, (double)sorted_size * sizeof(int), 1);
+        }
+        if (taskid == MASTER) {
+            final_sorted = (int *)malloc((data_size + 1) * sizeof(int));
+        }
+        if (!gather_to_master(sorted, sorted_size, final_sorted, arena, MPI_COMM_WORLD)) {
+            if (taskid == MASTER) {
+                fprintf(stderr, "Not enough memory to gather the sorted array\n");
+            }
+            free(final_sorted);
+            final_sorted = NULL;
+        }
+        stats_stop(&stats);
+    }
+
+    stats_start(&stats, PHASE_WRITE);
+    if (taskid == MASTER) {
+        if (final_sorted != NULL) {
+            printf("\nFinal sorted array:\n");
+            printArray(final_sorted, data_size, demo_mode);
+        }
+        format_result(result, result_size, "psrs", opts, numtasks, times, verified,
+                      adaptive ? adapt_engine_name(plan, "psrs") : "psrs", adaptive ? plan.kernel : opts->kernel);
+    }
+    stats_stop(&stats);
+
+    stats_report(&stats, MPI_COMM_WORLD, "psrs", data_size, opts->stats_file);
 
+    free(times);
+    free(local_input);
+    free(final_sorted);
+    return 0;
+}
+
+/*
+    Reserve the slots psrs_sort() and auto_sort() use for n keys: the keys
+    slot only without shm (with it the slice is sorted in the shared
+    segment), a receive buffer only for off-node partitions, and kernel
+    scratch beyond the merge heap only for the kernels that need it.
+*/
+bool psrs_reserve(sort_arena *arena, long long n, int numtasks, const char *kernel, const node_shm *shm)
+{
+    size_t share = (size_t)(n / numtasks + 1);
+    size_t exchanged = 2 * share + numtasks;    // PSRS leaves each rank fewer than 2n/p keys
+    size_t local = (share > (size_t)numtasks * numtasks) ? share : (size_t)numtasks * numtasks;
+    size_t merged = exchanged;
+    if (strcmp(kernel, "auto") == 0 && n <= ADAPT_GATHER_MAX_KEYS) {
+        // The gather plan merges and sorts all n keys on MASTER
+        merged = (merged > (size_t)n + 1) ? merged : (size_t)n + 1;
+        local = (local > (size_t)n) ? local : (size_t)n;
+    }
+    size_t heap = 2 * (size_t)(numtasks + 1) * sizeof(int);
+    size_t scratch = kernel_scratch_bytes(kernel, local);
+
+    size_t bytes[NUM_ARENA_SLOTS] = {0};
+    bytes[ARENA_KEYS] = (shm == NULL) ? share * sizeof(int) : 0;
+    bytes[ARENA_SAMPLES] = (size_t)(numtasks + 2) * numtasks * sizeof(int);
+    bytes[ARENA_COUNTS] = numtasks * (sizeof(key_run) + 7 * sizeof(int));
+    bytes[ARENA_RECV] = (shm != NULL && shm->node_size == numtasks) ? sizeof(int) : exchanged * sizeof(int);
+    bytes[ARENA_MERGE] = merged * sizeof(int);
+    bytes[ARENA_SCRATCH] = (scratch > heap) ? scratch : heap;
+    return arena_reserve(arena, bytes);
+}
+
+// Sort with the selected local kernel; runs and count use arena scratch
+void local_sort(int arr[], int size, const char *kernel, sort_arena *arena)
+{
+    if (strcmp(kernel, "qsort") == 0) {
+        qsort(arr, size, sizeof(int), compare_ints);
+    } else if (strcmp(kernel, "runs") == 0) {
+        natural_merge_sort(arr, size, arena);
+    } else if (strcmp(kernel, "count") == 0) {
+        if (!counting_sort(arr, size, arena)) {
+            qsort(arr, size, sizeof(int), compare_ints);
+        }
+    } else {
+        quickSort(arr, 0, size - 1);
+    }
+}
+
+/*
+    Parallel sorting by regular sampling. Sorts this rank's local_array in
+    place, exchanges partitions, and returns this rank's part of the global
+    order (*sorted_size keys, in arena's ARENA_MERGE slot until the next
+    sort); rank order is key order. If shm is set, local_array must be this
+    rank's node_shm_local() segment. Returns NULL on every rank if the
+    exchange buffers cannot grow to the partition sizes.
+*/
+int *psrs_sort(int *local_array, int local_size, int *sorted_size, int taskid, int numtasks,
+               const char *kernel, node_shm *shm, sort_arena *arena, sort_stats *stats)
+{
     // Step 1: Local sort
-    int actual_local_size = (taskid == numtasks - 1) ? (data_size - local_size * (numtasks - 1)) : local_size;
-    quickSort(local_array, 0, actual_local_size - 1);
+    stats_start(stats, PHASE_LOCAL_SORT);
+    local_sort(local_array, local_size, kernel, arena);
+    stats_stop(stats);
 
-    // Step 2: Sampling
-    int *samples = (int *)malloc(numtasks * sizeof(int));
+    // Step 2: Sampling (regular samples; empty slices contribute INT_MAX).
+    // Samples, pivots and the gathered samples share one arena slot.
+    stats_start(stats, PHASE_SAMPLING);
+    int *samples = (int *)arena_get(arena, ARENA_SAMPLES, (numtasks + 2) * numtasks * sizeof(int));
+    int *pivots = samples + numtasks;
+    int *all_samples = pivots + numtasks;
     for (int i = 0; i < numtasks; i++) {
-        samples[i] = local_array[i * actual_local_size / numtasks];
+        samples[i] = (local_size > 0) ? local_array[(long long)i * local_size / numtasks] : INT_MAX;
     }
 
     // Gather samples on the master process
-    int *all_samples = NULL;
-    if (taskid == MASTER) {
-        all_samples = (int *)malloc(numtasks * numtasks * sizeof(int));
+    if (taskid != MASTER) {
+        stats_sent(stats, numtasks * sizeof(int), 1);
     }
     MPI_Gather(samples, numtasks, MPI_INT, all_samples, numtasks, MPI_INT, MASTER, MPI_COMM_WORLD);
+    stats_stop(stats);
     
-    int *pivots = (int *)malloc((numtasks - 1) * sizeof(int));
+    stats_start(stats, PHASE_PIVOT);
     if (taskid == MASTER) {
-        quickSort(all_samples, 0, numtasks * numtasks - 1);
+        local_sort(all_samples, numtasks * numtasks, kernel, arena);
         for (int i = 1; i < numtasks; i++) {
             pivots[i - 1] = all_samples[i * numtasks + numtasks / 2];
         }
+        stats_sent(stats, (double)(numtasks - 1) * (numtasks - 1) * sizeof(int), numtasks - 1);
     }
     MPI_Bcast(pivots, numtasks - 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+    stats_stop(stats);
 
-    // Step 4: Partition local array based on pivots
-    int *partition_sizes = (int *)malloc(numtasks * sizeof(int));
-    int **partitions = (int **)malloc(numtasks * sizeof(int *));
-    for (int i = 0; i < numtasks; i++) {
-        partitions[i] = (int *)malloc(local_size * sizeof(int));
-        partition_sizes[i] = 0;
-    }
+    // Step 4: Partition local array based on pivots. The slice is sorted, so
+    // each partition is a contiguous run of local_array and is sent in place.
+    // The merge runs and every per-rank count array come from one slot.
+    stats_start(stats, PHASE_EXCHANGE);
+    key_run *runs = (key_run *)arena_get(arena, ARENA_COUNTS, numtasks * (sizeof(key_run) + 7 * sizeof(int)));
+    int *partition_sizes = (int *)(runs + numtasks);
+    int *recv_counts = partition_sizes + numtasks;
+    int *send_offsets = recv_counts + numtasks;
+    int *recv_offsets = send_offsets + numtasks;
+    int *peer_offsets = recv_offsets + numtasks;
 
+    memset(partition_sizes, 0, numtasks * sizeof(int));
     int current_partition = 0;
-    for (int i = 0; i < actual_local_size; i++) {
-        if (current_partition < numtasks - 1 && local_array[i] > pivots[current_partition]) {
+    for (int i = 0; i < local_size; i++) {
+        while (current_partition < numtasks - 1 && local_array[i] > pivots[current_partition]) {
             current_partition++;
         }
-        partitions[current_partition][partition_sizes[current_partition]++] = local_array[i];
+        partition_sizes[current_partition]++;
     }
 
     // Step 4b: All-to-all communication to redistribute partitions
-    int *recv_counts = (int *)malloc(numtasks * sizeof(int));
     MPI_Alltoall(partition_sizes, 1, MPI_INT, recv_counts, 1, MPI_INT, MPI_COMM_WORLD);
 
-    int *recv_offsets = (int *)malloc(numtasks * sizeof(int));
-    int *send_offsets = (int *)malloc(numtasks * sizeof(int));
-    int total_recv = 0;
     for (int i = 0; i < numtasks; i++) {
         send_offsets[i] = (i == 0) ? 0 : send_offsets[i - 1] + partition_sizes[i - 1];
-        recv_offsets[i] = total_recv;
+    }
+
+    // With shm, same-node partitions stay in the sender's segment and are
+    // merged from there; only the off-node ones go through MPI_Alltoallv
+    int *send_counts = partition_sizes;
+    int *net_recv_counts = recv_counts;
+    if (shm != NULL) {
+        MPI_Alltoall(send_offsets, 1, MPI_INT, peer_offsets, 1, MPI_INT, MPI_COMM_WORLD);
+
+        send_counts = peer_offsets + numtasks;
+        net_recv_counts = send_counts + numtasks;
+        for (int i = 0; i < numtasks; i++) {
+            bool same_node = shm->node_of[i] >= 0;
+            send_counts[i] = same_node ? 0 : partition_sizes[i];
+            net_recv_counts[i] = same_node ? 0 : recv_counts[i];
+        }
+    }
+
+    int total_recv = 0, net_recv = 0;
+    for (int i = 0; i < numtasks; i++) {
+        recv_offsets[i] = net_recv;
+        net_recv += net_recv_counts[i];
         total_recv += recv_counts[i];
     }
 
-    int *recv_buffer = (int *)malloc(total_recv * sizeof(int));
-    MPI_Alltoallv(&partitions[0][0], partition_sizes, send_offsets, MPI_INT, recv_buffer, recv_counts, recv_offsets, MPI_INT, MPI_COMM_WORLD);
+    // Both buffers are sized from the real counts. With duplicate keys they
+    // can pass the 2n/p reservation; if one cannot grow, every rank stops
+    // here together rather than exchange into it
+    int *recv_buffer = (int *)arena_get(arena, ARENA_RECV, (net_recv + 1) * sizeof(int));
+    int *sorted = (int *)arena_get(arena, ARENA_MERGE, (total_recv + 1) * sizeof(int));
+    int buffers_ok = recv_buffer != NULL && sorted != NULL, all_buffers_ok;
+    MPI_Allreduce(&buffers_ok, &all_buffers_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_buffers_ok) {
+        stats_stop(stats);
+        return NULL;
+    }
+    for (int i = 0; i < numtasks; i++) {
+        if (i != taskid && send_counts[i] > 0) {
+            stats_sent(stats, (double)send_counts[i] * sizeof(int), 1);
+        }
+    }
+    MPI_Alltoallv(local_array, send_counts, send_offsets, MPI_INT, recv_buffer, net_recv_counts, recv_offsets, MPI_INT, MPI_COMM_WORLD);
+    stats_stop(stats);
+    stats_exchanged(stats, total_recv);
 
-    // Step 5: Local merging of received partitions
-    quickSort(recv_buffer, 0, total_recv - 1);
+    // Step 5: Local merging of received partitions. Each one is a sorted
+    // run, so a p-way merge replaces re-sorting the whole buffer.
+    stats_start(stats, PHASE_MERGE);
+    if (shm != NULL) {
+        node_shm_publish(shm);
+    }
+    for (int i = 0; i < numtasks; i++) {
+        int node_rank = (shm != NULL) ? shm->node_of[i] : -1;
+        runs[i].keys = (node_rank >= 0) ? node_shm_peer(shm, node_rank) + peer_offsets[i]
+                                        : recv_buffer + recv_offsets[i];
+        runs[i].count = recv_counts[i];
+    }
+    merge_runs(runs, numtasks, sorted, arena);
+    if (shm != NULL) {
+        node_shm_release(shm);
+    }
+    stats_stop(stats);
 
-    // Gather sorted data at the master process
-    int *final_sorted = NULL;
-    if (taskid == MASTER) {
-        final_sorted = (int *)malloc(data_size * sizeof(int));
+    *sorted_size = total_recv;
+    return sorted;
+}
+
+/*
+    --kernel auto: profile the input and sort it the way adapt_plan() picks,
+    possibly without any exchange. Same contract as psrs_sort(); the
+    measurements and the decision are left in *profile and *plan.
+*/
+int *auto_sort(int *local_array, int local_size, int *sorted_size, int taskid, int numtasks,
+               node_shm *shm, sort_arena *arena, sort_stats *stats, adapt_profile *profile, adapt_decision *plan)
+{
+    stats_start(stats, PHASE_PROFILE);
+    adapt_profile_keys(local_array, local_size, MPI_COMM_WORLD, profile);
+    *plan = adapt_plan(profile, numtasks, "quick", "runs");
+    stats_stop(stats);
+
+    if (plan->engine == ADAPT_PARALLEL) {
+        return psrs_sort(local_array, local_size, sorted_size, taskid, numtasks, plan->kernel, shm, arena, stats);
     }
-    MPI_Gather(&total_recv, 1, MPI_INT, recv_counts, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
-    MPI_Gatherv(recv_buffer, total_recv, MPI_INT, final_sorted, recv_counts, recv_offsets, MPI_INT, MASTER, MPI_COMM_WORLD);
 
-    if (taskid == MASTER) {
-        printf("\nFinal sorted array:\n");
-        printArray(final_sorted, data_size, demo_mode);
+    // Ordered: rank order is already key order, so every slice just sorts
+    // itself in place. Gather: MASTER sorts everything.
+    int *sorted = local_array;
+    *sorted_size = local_size;
+    if (plan->engine == ADAPT_GATHER) {
+        stats_start(stats, PHASE_EXCHANGE);
+        if (taskid != MASTER) {
+            stats_sent(stats, (double)local_size * sizeof(int), 1);
+        }
+        *sorted_size = (taskid == MASTER) ? (int)profile->n : 0;
+        sorted = (int *)arena_get(arena, ARENA_MERGE, (*sorted_size + 1) * sizeof(int));
+        bool gathered = gather_to_master(local_array, local_size, sorted, arena, MPI_COMM_WORLD);
+        stats_stop(stats);
+        if (!gathered) {
+            return NULL;
+        }
     }
 
-    MPI_Finalize();
-    return 0;
+    stats_start(stats, PHASE_LOCAL_SORT);
+    local_sort(sorted, *sorted_size, plan->kernel, arena);
+    stats_stop(stats);
+    return sorted;
 }
 
 /*
@@ -170,12 +516,3 @@ void printArray(int arr[], int size, bool demo_mode)
     }
 }
 
-// Function to create an array of random numbers
-int* create_array(int size) {
-    int* numbers = (int *)malloc(size * sizeof(int));
-    for (int i = 0; i < size; i++) {
-        numbers[i] = rand() % (MAXNUMBER + 1);
-    }
-    return numbers;
-}
-
@@ -0,0 +1,135 @@
+import argparse
+import csv
+import subprocess
+import sys
+
+# Benchmark driver for the sort engines. Runs every engine / kernel over a grid
+# of sizes, rank counts and input distributions, and writes one CSV row per run.
+# Build the engines first (see notes.txt), then e.g.
+#   python3 bench.py --sizes 100000 1000000 --ranks 1 2 4 --out bench.csv
+#   python3 bench.py --out new.csv --baseline old.csv   # flag regressions
+
+# engine name -> (default binary, local kernels, rank counts it accepts, extra options)
+ENGINES = {
+    "seq": ("./quicksort_seq", ["quick", "qsort"], lambda p: p == 1, []),
+    "psrs": ("./psrs", ["quick", "qsort", "runs", "count", "auto"], lambda p: p >= 1, []),
+    "psrs-shm": ("./psrs", ["quick", "qsort", "runs", "count", "auto"], lambda p: p >= 1, ["--shm"]),
+    "hypercube": ("./qsp_null.o", ["std", "qsort", "runs", "count", "auto"], lambda p: p & (p - 1) == 0, []),
+    "hypercube-shm": ("./qsp_null.o", ["std", "qsort", "runs", "count", "auto"], lambda p: p & (p - 1) == 0, ["--shm"]),
+}
+
+DISTS = ["uniform", "sorted", "reversed", "few-unique", "zipf", "organ-pipe"]
+
+FIELDS = ["commit", "engine", "kernel", "dist", "n", "ranks", "repeat",
+          "median_s", "min_s", "max_s", "verified", "plan_engine", "plan_kernel"]
+
+
+def git_commit():
+    try:
+        return subprocess.check_output(["git", "rev-parse", "--short", "HEAD"],
+                                       text=True, stderr=subprocess.DEVNULL).strip()
+    except (OSError, subprocess.CalledProcessError):
+        return "unknown"
+
+
+# Run one engine configuration and return its CSV row
+def run_one(args, engine, binary, kernel, dist, n, ranks):
+    cmd = args.mpirun.split() + ["-np", str(ranks), binary,
+                                 "--quiet", "--n", str(n), "--dist", dist,
+                                 "--max", str(args.max), "--seed", str(args.seed),
+                                 "--kernel", kernel, "--warmup", str(args.warmup),
+                                 "--repeat", str(args.repeat)] + ENGINES[engine][3]
+    row = {"engine": engine, "kernel": kernel, "dist": dist, "n": n,
+           "ranks": ranks, "repeat": args.repeat}
+    try:
+        out = subprocess.run(cmd, capture_output=True, text=True, timeout=args.timeout)
+    except subprocess.TimeoutExpired:
+        row["verified"] = "timeout"
+        return row
+
+    for line in out.stdout.splitlines():
+        parts = line.split()
+        if parts and parts[0] == "RESULT":
+            row["median_s"], row["min_s"], row["max_s"] = parts[7], parts[8], parts[9]
+            row["verified"] = "ok" if parts[10] == "1" else "WRONG"
+            # What ran, which --kernel auto decides per input
+            row["plan_engine"], row["plan_kernel"] = parts[11], parts[12]
+            return row
+    row["verified"] = "error"
+    return row
+
+
+# Compare medians against a baseline CSV, print regressions, return their count
+def compare(rows, baseline_file, threshold):
+    key = lambda r: (r["engine"], r["kernel"], r["dist"], str(r["n"]), str(r["ranks"]))
+    with open(baseline_file) as file:
+        baseline = {key(r): r for r in csv.DictReader(file)}
+
+    regressions = 0
+    for row in rows:
+        old = baseline.get(key(row))
+        if old is None or not old.get("median_s") or not row.get("median_s"):
+            continue
+        ratio = float(row["median_s"]) / float(old["median_s"])
+        if ratio > 1 + threshold:
+            regressions += 1
+            print(f"REGRESSION {' '.join(key(row))}: {old['median_s']}s -> {row['median_s']}s ({ratio:.2f}x)")
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the sort engines")
+    parser.add_argument("--engines", nargs="+", default=list(ENGINES), choices=list(ENGINES))
+    parser.add_argument("--kernels", nargs="+", help="restrict to these local kernels")
+    parser.add_argument("--sizes", nargs="+", type=int, default=[100000])
+    parser.add_argument("--ranks", nargs="+", type=int, default=[1, 2, 4])
+    parser.add_argument("--dists", nargs="+", default=DISTS, choices=DISTS)
+    parser.add_argument("--max", type=int, default=1000000, help="largest key value")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--warmup", type=int, default=1)
+    parser.add_argument("--repeat", type=int, default=5)
+    parser.add_argument("--timeout", type=float, default=300, help="seconds per configuration")
+    parser.add_argument("--mpirun", default="mpirun")
+    parser.add_argument("--binary", action="append", default=[], metavar="ENGINE=PATH",
+                        help="override an engine's executable")
+    parser.add_argument("--out", default="bench.csv")
+    parser.add_argument("--baseline", help="earlier CSV to check for regressions")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="slowdown fraction reported as a regression")
+    args = parser.parse_args()
+
+    binaries = {name: spec[0] for name, spec in ENGINES.items()}
+    for override in args.binary:
+        name, path = override.split("=", 1)
+        binaries[name] = path
+
+    commit = git_commit()
+    rows = []
+    with open(args.out, "w", newline="") as file:
+        writer = csv.DictWriter(file, fieldnames=FIELDS)
+        writer.writeheader()
+        for engine in args.engines:
+            _, kernels, accepts, _ = ENGINES[engine]
+            for kernel in kernels:
+                if args.kernels and kernel not in args.kernels:
+                    continue
+                for ranks in args.ranks:
+                    if not accepts(ranks):
+                        continue
+                    for n in args.sizes:
+                        for dist in args.dists:
+                            row = run_one(args, engine, binaries[engine], kernel, dist, n, ranks)
+                            row["commit"] = commit
+                            rows.append(row)
+                            writer.writerow(row)
+                            file.flush()
+                            print(",".join(str(row.get(f, "")) for f in FIELDS))
+
+    failed = sum(1 for r in rows if r["verified"] != "ok")
+    regressions = compare(rows, args.baseline, args.threshold) if args.baseline else 0
+    print(f"{len(rows)} runs written to {args.out}, {failed} failed, {regressions} regressions")
+    return 1 if failed or regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,106 @@
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "sort_bench.h"
+#include "gen_keys.h"
+
+#define MASTER 0        /* task id of master task */
+
+// Function declarations
+bool write_text(const char *file_name, const sort_opts *opts);
+
+/*
+    Parallel input generator, replacing gen-rand.py and gen-rand_input.py.
+    With --shards PREFIX every rank generates its own block of the input and
+    writes PREFIX.<rank>.bin, ready for `psrs --shards PREFIX` on the same
+    number of ranks. With --text FILE, MASTER writes the "{a, b, ...};"
+    format that qsp_null reads from input.txt.
+*/
+int main(int argc, char *argv[])
+{
+    int taskid, numtasks;
+
+    sort_opts opts = {0};
+    opts.n = 50000;
+    opts.dist = DIST_UNIFORM;
+    opts.max_value = 1000;
+    opts.skew = 1.0;
+    opts.seed = 1;
+    opts.repeat = 1;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
+
+    if (!parse_sort_opts(argc, argv, &opts, taskid == MASTER) || opts.n < 1 ||
+        (opts.shards == NULL && opts.text_file == NULL)) {
+        if (taskid == MASTER) {
+            fprintf(stderr, "Usage: gen_keys [--n N] [--dist D] [--max M] [--skew Z] [--seed S]\n"
+                            "                (--shards PREFIX | --text FILE)\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    int ok = 1, all_ok;
+    double start = MPI_Wtime();
+
+    if (opts.shards != NULL) {
+        shard_header h;
+        long long first;
+        int count;
+
+        block_range(opts.n, numtasks, taskid, &first, &count);
+        int *keys = (int *)malloc((count + 1) * sizeof(int));
+        gen_keys(&opts, first, count, keys);
+
+        memcpy(h.magic, SHARD_MAGIC, 4);
+        h.version = SHARD_VERSION;
+        h.total = opts.n;
+        h.first = first;
+        h.count = count;
+        h.seed = opts.seed;
+        h.dist = (uint32_t)opts.dist;
+        h.max_value = opts.max_value;
+        h.skew = opts.skew;
+        ok = write_shard(opts.shards, taskid, &h, keys);
+        free(keys);
+    }
+    if (opts.text_file != NULL && taskid == MASTER) {
+        ok = ok && write_text(opts.text_file, &opts);
+    }
+
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    double elapsed = MPI_Wtime() - start;
+
+    if (taskid == MASTER && all_ok) {
+        printf("%d %s keys in [0, %d] (seed %u) generated on %d tasks in %f s (%.1f Mkeys/s)\n",
+               opts.n, input_dist_names[opts.dist], opts.max_value, opts.seed, numtasks,
+               elapsed, opts.n / elapsed / 1e6);
+    }
+
+    MPI_Finalize();
+    return all_ok ? 0 : 1;
+}
+
+// Write the whole input in C array format: {a, b, ...};
+bool write_text(const char *file_name, const sort_opts *opts)
+{
+    FILE *file = fopen(file_name, "w");
+    if (file == NULL) {
+        fprintf(stderr, "Error writing file: %s\n", file_name);
+        return false;
+    }
+
+    int *numbers = create_input(opts);
+    fprintf(file, "{");
+    for (int i = 0; i < opts->n; i++) {
+        fprintf(file, i == 0 ? "%d" : ", %d", numbers[i]);
+    }
+    fprintf(file, "};");
+    free(numbers);
+
+    return fclose(file) == 0;
+}
@@ -0,0 +1,250 @@
+/*
+    Counter-based key generator and binary shard I/O.
+
+    Key i is a pure function of (seed, i, n, distribution), computed with the
+    SplitMix64 finalizer, so any rank or thread can produce any slice of the
+    input without coordination and the result does not depend on how many
+    ranks or threads were used. Build with -fopenmp to fill slices in parallel.
+
+    Shard file <prefix>.<rank>.bin: shard_header followed by `count` native
+    int keys, holding keys [first, first + count) of a `total`-key input and
+    the generator options it was made with.
+*/
+#ifndef GEN_KEYS_H
+#define GEN_KEYS_H
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+#include "sort_bench.h"
+
+#ifndef MASTER
+#define MASTER 0
+#endif
+
+#define FEW_UNIQUE_KEYS 16  /* distinct keys in the few-unique distribution */
+
+#define SHARD_MAGIC "A2SK"
+#define SHARD_VERSION 2
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t total;     /* keys in the whole input */
+    uint64_t first;     /* index of this shard's first key */
+    uint64_t count;     /* keys in this shard */
+    uint64_t seed;      /* generator options the input was made with */
+    uint32_t dist;
+    int32_t max_value;
+    double skew;
+} shard_header;
+
+// SplitMix64 output function
+static inline uint64_t mix64(uint64_t z)
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// The i-th 64-bit random value of the stream selected by seed
+static inline uint64_t counter_random(uint64_t seed, uint64_t i)
+{
+    return mix64(mix64(seed) + (i + 1) * 0x9E3779B97F4A7C15ULL);
+}
+
+/*
+    Bounded power law with exponent o->skew over the keys 0..max_value,
+    by inverting the continuous CDF of (x + 1)^-skew on [0, max_value + 1).
+*/
+static inline int zipf_key(const sort_opts* o, double u)
+{
+    double keys = (double)o->max_value + 1;
+    double a = 1.0 - o->skew;
+    double x;
+
+    if (fabs(a) < 1e-9) {
+        x = exp(u * log(keys + 1)) - 1;
+    } else {
+        x = pow(u * (pow(keys + 1, a) - 1) + 1, 1 / a) - 1;
+    }
+    return (x < keys) ? (int)x : o->max_value;
+}
+
+// Key i of the o->n-key input described by o
+static inline int gen_key(const sort_opts* o, long long i)
+{
+    uint64_t range = (uint64_t)o->max_value + 1;
+    uint64_t n = (uint64_t)o->n;
+    uint64_t h = counter_random(o->seed, (uint64_t)i);
+
+    switch (o->dist) {
+    case DIST_SORTED:
+        return (int)((uint64_t)i * range / n);
+    case DIST_REVERSED:
+        return (int)((n - 1 - (uint64_t)i) * range / n);
+    case DIST_FEW_UNIQUE:
+        return (int)((h % FEW_UNIQUE_KEYS) * range / FEW_UNIQUE_KEYS);
+    case DIST_ZIPF:
+        return zipf_key(o, (double)(h >> 11) * (1.0 / 9007199254740992.0));
+    case DIST_ORGAN_PIPE: {
+        uint64_t up = ((uint64_t)i < n - (uint64_t)i) ? (uint64_t)i : n - 1 - (uint64_t)i;
+        return (int)(2 * up * range / (n + 1));
+    }
+    default:
+        return (int)(((h >> 32) * range) >> 32);
+    }
+}
+
+// Fill out[0..count) with keys [first, first + count)
+static inline void gen_keys(const sort_opts* o, long long first, int count, int* out)
+{
+    #pragma omp parallel for schedule(static)
+    for (int i = 0; i < count; i++) {
+        out[i] = gen_key(o, first + i);
+    }
+}
+
+// Block distribution of n keys: the first n % ranks ranks get one extra key
+static inline void block_range(long long n, int ranks, int rank, long long* first, int* count)
+{
+    long long base = n / ranks, extra = n % ranks;
+    *first = rank * base + (rank < extra ? rank : extra);
+    *count = (int)(base + (rank < extra ? 1 : 0));
+}
+
+// Function to create the whole o->n-key input array
+static inline int* create_input(const sort_opts* o)
+{
+    int* numbers = (int*)malloc((o->n > 0 ? o->n : 1) * sizeof(int));
+    gen_keys(o, 0, o->n, numbers);
+    return numbers;
+}
+
+static inline void shard_path(char* path, size_t size, const char* prefix, int rank)
+{
+    snprintf(path, size, "%s.%d.bin", prefix, rank);
+}
+
+static inline bool write_shard(const char* prefix, int rank, const shard_header* h, const int* keys)
+{
+    char path[4096];
+    shard_path(path, sizeof(path), prefix, rank);
+
+    FILE* f = fopen(path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "Error writing shard: %s\n", path);
+        return false;
+    }
+    bool ok = fwrite(h, sizeof(*h), 1, f) == 1 &&
+              fwrite(keys, sizeof(int), h->count, f) == h->count;
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        fprintf(stderr, "Error writing shard: %s\n", path);
+    }
+    return ok;
+}
+
+// Returns the shard's keys (malloc'd) and fills h, or NULL on error or if
+// the shard is too large for the drivers' int sizes
+static inline int* read_shard(const char* prefix, int rank, shard_header* h)
+{
+    char path[4096];
+    shard_path(path, sizeof(path), prefix, rank);
+
+    FILE* f = fopen(path, "rb");
+    if (f == NULL || fread(h, sizeof(*h), 1, f) != 1 ||
+        memcmp(h->magic, SHARD_MAGIC, 4) != 0 || h->version != SHARD_VERSION || h->dist >= NUM_DISTS ||
+        h->count > INT_MAX || h->total > INT_MAX) {
+        fprintf(stderr, "Error reading shard: %s\n", path);
+        if (f != NULL) {
+            fclose(f);
+        }
+        return NULL;
+    }
+    int* keys = (int*)malloc((h->count > 0 ? h->count : 1) * sizeof(int));
+    if (fread(keys, sizeof(int), h->count, f) != h->count) {
+        fprintf(stderr, "Error reading shard: %s\n", path);
+        free(keys);
+        keys = NULL;
+    }
+    fclose(f);
+    return keys;
+}
+
+/*
+    Collective over comm. True on every rank if every rank read its shard
+    (read_ok) and the shards are exactly one input in rank order: they share
+    the same total, each one starts where the previous rank's ended, and
+    together they hold all total keys.
+*/
+static inline bool shards_complete(const shard_header* h, bool read_ok, MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    long long count = read_ok ? (long long)h->count : 0;
+    long long total = read_ok ? (long long)h->total : 0;
+    long long expected_first = 0;
+    MPI_Exscan(&count, &expected_first, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    if (rank == 0) {
+        expected_first = 0;
+    }
+
+    // flags: read, lined up with the previous shard; totals: max and -min
+    int flags[2] = { read_ok, read_ok && (long long)h->first == expected_first }, all_flags[2];
+    long long sum_count, totals[2] = { total, -total }, max_totals[2];
+    MPI_Allreduce(flags, all_flags, 2, MPI_INT, MPI_MIN, comm);
+    MPI_Allreduce(&count, &sum_count, 1, MPI_LONG_LONG, MPI_SUM, comm);
+    MPI_Allreduce(totals, max_totals, 2, MPI_LONG_LONG, MPI_MAX, comm);
+
+    bool complete = all_flags[1] && max_totals[0] == -max_totals[1] && sum_count == max_totals[0];
+    if (!complete && all_flags[0] && rank == MASTER) {
+        fprintf(stderr, "Shards do not form one complete input over these ranks\n");
+    }
+    return complete;
+}
+
+/*
+    Collective over comm: this rank's block of the input o describes, read
+    from the o->shards shards or generated (malloc'd), with its size in
+    *count and the input size in *total. Shards also set o's generator
+    options, so RESULT names the input they hold. NULL on every rank if a
+    shard is missing or the shards are not one complete input.
+*/
+static inline int* load_keys(sort_opts* o, MPI_Comm comm, int* count, int* total)
+{
+    int rank, ranks;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    if (o->shards != NULL) {
+        shard_header h;
+        int* keys = read_shard(o->shards, rank, &h);
+        if (!shards_complete(&h, keys != NULL, comm)) {
+            free(keys);
+            return NULL;
+        }
+        *count = (int)h.count;
+        *total = (int)h.total;
+        o->seed = (unsigned)h.seed;
+        o->dist = (int)h.dist;
+        o->max_value = h.max_value;
+        o->skew = h.skew;
+        return keys;
+    }
+
+    long long first;
+    block_range(o->n, ranks, rank, &first, count);
+    int* keys = (int*)malloc((*count > 0 ? *count : 1) * sizeof(int));
+    gen_keys(o, first, *count, keys);
+    *total = o->n;
+    return keys;
+}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+    Node-local shared memory for the exchange phases.
+
+    Ranks on the same node (MPI_COMM_TYPE_SHARED) each own one segment of an
+    MPI-3 shared window and can load directly from each other's segments, so
+    same-node partitions never go through the MPI transport. The window is
+    kept between sorts and only reallocated when a segment has to grow.
+
+    Usage per exchange: write into node_shm_local(), node_shm_publish(),
+    read peers through node_shm_peer(), then node_shm_release() before the
+    segment is written again.
+*/
+#ifndef NODE_SHM_H
+#define NODE_SHM_H
+
+#include "mpi.h"
+#include <stdlib.h>
+#include <stdbool.h>
+
+typedef struct {
+    MPI_Comm node_comm;
+    int node_rank, node_size;
+    int* node_of;           /* world rank -> node rank, -1 if on another node */
+    MPI_Win win;
+    bool has_win;
+    MPI_Aint capacity;      /* ints per segment, the same on every node rank */
+} node_shm;
+
+// Collective over comm
+static inline void node_shm_init(node_shm* s, MPI_Comm comm)
+{
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &s->node_comm);
+    MPI_Comm_rank(s->node_comm, &s->node_rank);
+    MPI_Comm_size(s->node_comm, &s->node_size);
+
+    // Map world ranks to node ranks through the node's list of world ranks
+    int* members = (int*)malloc(s->node_size * sizeof(int));
+    MPI_Allgather(&rank, 1, MPI_INT, members, 1, MPI_INT, s->node_comm);
+    s->node_of = (int*)malloc(size * sizeof(int));
+    for (int i = 0; i < size; i++) {
+        s->node_of[i] = -1;
+    }
+    for (int i = 0; i < s->node_size; i++) {
+        s->node_of[members[i]] = i;
+    }
+    free(members);
+
+    s->has_win = false;
+    s->capacity = 0;
+}
+
+static inline void node_shm_free(node_shm* s)
+{
+    if (s->has_win) {
+        MPI_Win_unlock_all(s->win);
+        MPI_Win_free(&s->win);
+    }
+    MPI_Comm_free(&s->node_comm);
+    free(s->node_of);
+}
+
+/*
+    Collective over the node: make every segment hold at least count ints
+    (the largest request on the node wins). Contents are lost on growth.
+*/
+static inline void node_shm_reserve(node_shm* s, int count)
+{
+    int need;
+    MPI_Allreduce(&count, &need, 1, MPI_INT, MPI_MAX, s->node_comm);
+    if (s->has_win && need <= s->capacity) {
+        return;
+    }
+    if (s->has_win) {
+        MPI_Win_unlock_all(s->win);
+        MPI_Win_free(&s->win);
+    }
+
+    // Grow geometrically so a run of slightly larger sorts does not reallocate each time
+    s->capacity = (need > 2 * s->capacity) ? need : 2 * s->capacity;
+    void* base;
+    MPI_Win_allocate_shared((s->capacity + 1) * sizeof(int), sizeof(int), MPI_INFO_NULL,
+                            s->node_comm, &base, &s->win);
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, s->win);
+    s->has_win = true;
+}
+
+// Segment of the node rank peer; this rank's own when peer == s->node_rank
+static inline int* node_shm_peer(const node_shm* s, int peer)
+{
+    MPI_Aint size;
+    int disp_unit;
+    int* base;
+    MPI_Win_shared_query(s->win, peer, &size, &disp_unit, &base);
+    return base;
+}
+
+static inline int* node_shm_local(const node_shm* s)
+{
+    return node_shm_peer(s, s->node_rank);
+}
+
+// Make this rank's writes visible to the node and wait for everyone's
+static inline void node_shm_publish(const node_shm* s)
+{
+    MPI_Win_sync(s->win);
+    MPI_Barrier(s->node_comm);
+    MPI_Win_sync(s->win);
+}
+
+// Wait until the node has finished reading before segments are reused
+static inline void node_shm_release(const node_shm* s)
+{
+    MPI_Barrier(s->node_comm);
+}
+
+#endif
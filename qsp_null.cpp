@@ -6,10 +6,50 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
+#include <cstring>
+#include <climits>
+#include "sort_stats.h"
+#include "sort_bench.h"
+#include "gen_keys.h"
+#include "sort_verify.h"
+#include "sort_service.h"
+#include "node_shm.h"
+#include "sort_adapt.h"
+#include "sort_arena.h"
 
 #define MASTER 0
+#define SHM_HEADER_INTS 4   /* per round parity, see shm_segment_size() */
 
-void hypercube_quicksort(std::vector<int>& B, int d, int id);
+int* hypercube_quicksort(int* keys, int size, int* sorted_size, const std::vector<MPI_Comm>& cubes, int id,
+                         const char* kernel, node_shm* shm, sort_arena* arena, sort_stats* stats);
+
+int* auto_sort(int* keys, int size, int* sorted_size, const std::vector<MPI_Comm>& cubes, int id,
+               node_shm* shm, sort_arena* arena, sort_stats* stats, adapt_profile* profile, adapt_decision* plan);
+
+std::vector<MPI_Comm> make_subcubes(int d, int id);
+
+int shm_segment_size(int size);
+
+int shm_half_capacity(const node_shm* shm);
+
+int* shm_half(const node_shm* shm, int node_rank, int half);
+
+bool hypercube_reserve(sort_arena* arena, long long n, int numtasks, int id, const char* kernel,
+                       const node_shm* shm);
+
+bool valid_opts(const sort_opts* opts);
+
+int run_job(sort_opts* opts, void* context, char* result, size_t result_size);
+
+// What run_job needs besides its options, kept across service jobs
+struct job_context {
+    int taskid, numtasks;
+    std::vector<MPI_Comm> cubes;
+    node_shm* shm;
+    sort_arena* arena;
+};
+
+void local_sort(int* B, int size, const char* kernel, sort_arena* arena);
 
 std::vector<int> parse_input_file(const std::string& filename);
 
@@ -17,11 +57,29 @@ int main(int argc, char* argv[]) {
     int taskid, numtasks;
     int d;  // Dimension of the hypercube
 
+    // Defaults: read input.txt, as before the benchmark options existed
+    sort_opts opts = {};
+    opts.dist = DIST_UNIFORM;
+    opts.max_value = 1000;
+    opts.skew = 1.0;
+    opts.seed = 1;
+    opts.kernel = "std";
+    opts.repeat = 1;
+    opts.input_file = "input.txt";
+
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
 
-    double start_time = MPI_Wtime();  // Start timing the main execution
+    if (!parse_sort_opts(argc, argv, &opts, taskid == MASTER) || !valid_opts(&opts)) {
+        if (taskid == MASTER) {
+            std::cerr << "Usage: qsp_null [--input FILE | --n N --dist D --max M --skew Z --seed S | --shards PREFIX]\n"
+                         "                [--kernel std|qsort|runs|count|auto] [--warmup W] [--repeat R] [--quiet] [--stats FILE]\n"
+                         "                [--shm] [--huge-pages] [--arena-limit MB] [--serve SOCKET]\n";
+        }
+        MPI_Finalize();
+        return 1;
+    }
 
     // Determine the hypercube dimension
     d = (int)log2(numtasks);
@@ -33,160 +91,534 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    std::vector<int> B;
-    int num_elements;
+    // The subcube communicators are the same for every sort, so build them once
+    std::vector<MPI_Comm> cubes = make_subcubes(d, taskid);
 
-    if (taskid == MASTER) {
-        // Read and parse the input file on the MASTER process
-        B = parse_input_file("input.txt");
+    // Kept for the whole run so --shm sorts reuse the node's shared window
+    node_shm shm;
+    node_shm_init(&shm, MPI_COMM_WORLD);
 
-        num_elements = B.size();
-        if (num_elements % numtasks != 0) {
-            std::cerr << "The number of elements must be divisible by the number of tasks.\n";
-            MPI_Finalize();
-            return 1;
+    // Sort buffers are kept for the whole run as well, across repeats and jobs
+    sort_arena arena;
+    arena_init(&arena, opts.huge_pages);
+
+    job_context context = { taskid, numtasks, cubes, &shm, &arena };
+    int status = 0;
+    if (opts.serve != nullptr) {
+        service_run(&opts, "hypercube", valid_opts, run_job, &context, MPI_COMM_WORLD);
+    } else {
+        char result[256];
+        status = run_job(&opts, &context, result, sizeof(result));
+        if (status == 0 && taskid == MASTER) {
+            std::cout << result << std::endl;
         }
+    }
 
-        std::cout << "Using explicitly provided list: ";
-        for (int val : B) std::cout << val << " ";
-        std::cout << std::endl;
+    arena_free(&arena);
+    node_shm_free(&shm);
+    for (MPI_Comm& comm : cubes) {
+        MPI_Comm_free(&comm);
     }
+    MPI_Finalize();
+    return status;
+}
 
-    // Broadcast the number of elements to all processes
-    MPI_Bcast(&num_elements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+bool valid_opts(const sort_opts* opts) {
+    return valid_kernel(opts->kernel, "std");
+}
+
+/*
+    Read (or generate) the input, sort it opts.warmup + opts.repeat times
+    and verify the result. context is the job_context. MASTER gets the
+    RESULT line in result. Returns non-zero on every rank if any rank failed
+    to read its input.
+*/
+int run_job(sort_opts* job, void* context, char* result, size_t result_size) {
+    const job_context& ctx = *static_cast<job_context*>(context);
+    sort_opts& opts = *job;
+    int taskid = ctx.taskid, numtasks = ctx.numtasks;
+    const std::vector<MPI_Comm>& cubes = ctx.cubes;
+    node_shm* shm = ctx.shm;
+    sort_arena* arena = ctx.arena;
+    double start_time = MPI_Wtime();  // Start timing the main execution
+    sort_stats stats;
+
+    std::vector<int> input, B;
+    std::vector<int> local_input;
+    int num_elements = 0;
+
+    // Generated inputs and shards are produced by every rank directly;
+    // a text input file is read on MASTER and scattered
+    double read_time = MPI_Wtime();
+    if (opts.shards != nullptr || opts.n > 0) {
+        int count;
+        int* keys = load_keys(&opts, MPI_COMM_WORLD, &count, &num_elements);
+        if (keys == nullptr) {
+            return 1;
+        }
+        local_input.assign(keys, keys + count);
+        free(keys);
+    } else if (taskid == MASTER) {
+        // Read and parse the input file on the MASTER process
+        input = parse_input_file(opts.input_file);
+        num_elements = input.size();
+    }
+    read_time = MPI_Wtime() - read_time;
 
-    int local_size = num_elements / numtasks;
-    std::vector<int> local_B(local_size);  // Local data buffer
+    double scatter_time = 0;
+    if (opts.shards == nullptr && opts.n == 0) {
+        scatter_time = MPI_Wtime();
 
-    // Scatter the data from the MASTER process to all processes
-    MPI_Scatter(B.data(), local_size, MPI_INT, local_B.data(), local_size, MPI_INT, MASTER, MPI_COMM_WORLD);
+        // Broadcast the number of elements to all processes
+        MPI_Bcast(&num_elements, 1, MPI_INT, MASTER, MPI_COMM_WORLD);
 
-    std::cout << "Process " << taskid << " initial array: ";
-    for (int val : local_B) {
-        std::cout << val << " ";
+        // Block distribution; the first num_elements % numtasks ranks get one extra key
+        std::vector<int> scatter_counts(numtasks), scatter_displs(numtasks);
+        for (int i = 0; i < numtasks; ++i) {
+            long long first;
+            block_range(num_elements, numtasks, i, &first, &scatter_counts[i]);
+            scatter_displs[i] = (int)first;
+        }
+        local_input.resize(scatter_counts[taskid]);
+
+        // Scatter the data from the MASTER process to all processes
+        MPI_Scatterv(input.data(), scatter_counts.data(), scatter_displs.data(), MPI_INT,
+                     local_input.data(), local_input.size(), MPI_INT, MASTER, MPI_COMM_WORLD);
+        scatter_time = MPI_Wtime() - scatter_time;
+    } else if (!opts.quiet) {
+        // Collect the generated input on MASTER for printing
+        if (taskid == MASTER) {
+            input.resize(num_elements);
+        }
+        if (!gather_to_master(local_input.data(), local_input.size(), input.data(), arena, MPI_COMM_WORLD)) {
+            input.clear();
+        }
     }
-    std::cout << std::endl;
+    opts.n = num_elements;
 
-    double sort_start_time = MPI_Wtime();  // Start timing the sorting
-    hypercube_quicksort(local_B, d, taskid);  // Perform hypercube quicksort
-    double sort_end_time = MPI_Wtime();    // End timing the sorting
+    key_digest input_digest = {0, 0, 0, 0};
+    digest_keys(&input_digest, local_input.data(), local_input.size());
 
-    std::cout << "Process " << taskid << " sorted array: ";
-    for (int val : local_B) {
-        std::cout << val << " ";
+    if (!opts.quiet) {
+        if (taskid == MASTER) {
+            std::cout << "Using explicitly provided list: ";
+            for (int val : input) std::cout << val << " ";
+            std::cout << std::endl;
+        }
+        std::cout << "Process " << taskid << " initial array: ";
+        for (int val : local_input) {
+            std::cout << val << " ";
+        }
+        std::cout << std::endl;
     }
-    std::cout << std::endl;
 
-    // Gather the sizes of local_B from all processes
-    int local_B_size = local_B.size();
-    std::vector<int> recv_counts(numtasks);
-    MPI_Gather(&local_B_size, 1, MPI_INT, recv_counts.data(), 1, MPI_INT, MASTER, MPI_COMM_WORLD);
+    // Size the arena up front so the runs below reuse its buffers; a job
+    // that does not fit fails on every rank, like one that cannot be read
+    arena_configure(arena, opts.huge_pages, (size_t)opts.arena_limit << 20);
+    int reserved = hypercube_reserve(arena, num_elements, numtasks, taskid, opts.kernel,
+                                     opts.shm ? shm : nullptr), all_reserved;
+    MPI_Allreduce(&reserved, &all_reserved, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+    if (!all_reserved) {
+        if (taskid == MASTER) {
+            std::cerr << "Sort buffers do not fit in memory or under --arena-limit\n";
+        }
+        return 1;
+    }
 
-    // Compute displacements for MPI_Gatherv
-    std::vector<int> displs(numtasks);
-    if (taskid == MASTER) {
-        displs[0] = 0;
-        for (int i = 1; i < numtasks; ++i) {
-            displs[i] = displs[i - 1] + recv_counts[i - 1];
+    int* local_B = nullptr;  // This rank's sorted keys, in the arena
+    int local_size = 0;
+    std::vector<double> times(opts.repeat);
+    double sort_start_time = 0, sort_end_time = 0;
+    bool adaptive = std::strcmp(opts.kernel, "auto") == 0;
+    adapt_profile profile;
+    adapt_decision plan;
+
+    // Warm-up runs first, then the timed ones; stats cover the last run
+    for (int run = -opts.warmup; run < opts.repeat; ++run) {
+        stats_reset(&stats);
+        // With --shm the keys start out in this rank's shared segment,
+        // sized here so the sort itself never reallocates the window
+        int* keys;
+        if (opts.shm) {
+            node_shm_reserve(shm, shm_segment_size(local_input.size()));
+            keys = shm_half(shm, shm->node_rank, 0);
+        } else {
+            keys = (int*)arena_get(arena, ARENA_KEYS, (local_input.size() + 1) * sizeof(int));
+        }
+        std::copy(local_input.begin(), local_input.end(), keys);
+        MPI_Barrier(MPI_COMM_WORLD);
+
+        sort_start_time = MPI_Wtime();  // Start timing the sorting
+        if (adaptive) {
+            local_B = auto_sort(keys, local_input.size(), &local_size, cubes, taskid,
+                                opts.shm ? shm : nullptr, arena, &stats, &profile, &plan);
+        } else {
+            local_B = hypercube_quicksort(keys, local_input.size(), &local_size, cubes, taskid, opts.kernel,
+                                          opts.shm ? shm : nullptr, arena, &stats);  // Perform hypercube quicksort
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        sort_end_time = MPI_Wtime();    // End timing the sorting
+
+        if (run >= 0) {
+            times[run] = sort_end_time - sort_start_time;
+        }
+
+        // A buffer that could not grow during the sort fails the job on every rank
+        int sort_ok = local_B != nullptr, all_sort_ok;
+        MPI_Allreduce(&sort_ok, &all_sort_ok, 1, MPI_INT, MPI_MIN, MPI_COMM_WORLD);
+        if (!all_sort_ok) {
+            if (taskid == MASTER) {
+                std::cerr << "Sort buffers outgrew memory or --arena-limit during the sort\n";
+            }
+            return 1;
         }
-        num_elements = displs[numtasks - 1] + recv_counts[numtasks - 1];
-        B.resize(num_elements);  // Resize B to hold the final sorted data
     }
+    stats.time[PHASE_READ] = read_time;
+    stats.arena_bytes = (double)arena_bytes(arena);
+    stats.arena_peak = (double)arena->peak;
+    stats.arena_limit = (double)arena->limit;
+    if (adaptive) {
+        adapt_log(&profile, plan, "hypercube", taskid);
+    }
+    stats.time[PHASE_SCATTER] = scatter_time;
+    if (taskid == MASTER && scatter_time > 0) {
+        stats.current = PHASE_SCATTER;
+        stats_sent(&stats, (double)(num_elements - local_input.size()) * sizeof(int), numtasks - 1);
+    }
+
+    stats_start(&stats, PHASE_VERIFY);
+    bool verified = verify_sorted(&input_digest, local_B, local_size, MPI_COMM_WORLD);
+    stats_stop(&stats);
+
+    if (!opts.quiet) {
+        std::cout << "Process " << taskid << " sorted array: ";
+        for (int i = 0; i < local_size; ++i) {
+            std::cout << local_B[i] << " ";
+        }
+        std::cout << std::endl;
 
-    // Gather all sorted segments at the MASTER process
-    MPI_Gatherv(local_B.data(), local_B_size, MPI_INT, B.data(), recv_counts.data(),
-                displs.data(), MPI_INT, MASTER, MPI_COMM_WORLD);
+        // Gather all sorted segments at the MASTER process
+        stats_start(&stats, PHASE_GATHER);
+        if (taskid != MASTER) {
+            stats_sent(&stats, (double)local_size * sizeof(int), 1);
+        }
+        if (taskid == MASTER) {
+            B.resize(num_elements);
+        }
+        if (!gather_to_master(local_B, local_size, B.data(), arena, MPI_COMM_WORLD)) {
+            if (taskid == MASTER) {
+                std::cerr << "Not enough memory to gather the sorted array\n";
+            }
+            B.clear();
+        }
+        stats_stop(&stats);
+    }
 
+    stats_start(&stats, PHASE_WRITE);
     if (taskid == MASTER) {
         // The data in B is already sorted across processes
-        std::cout << "Final sorted list: ";
-        for (int val : B) std::cout << val << " ";
-        std::cout << std::endl;
+        if (!opts.quiet) {
+            if (B.size() == (size_t)num_elements) {
+                std::cout << "Final sorted list: ";
+                for (int val : B) std::cout << val << " ";
+                std::cout << std::endl;
+            }
 
-        double end_time = MPI_Wtime();  // End timing the entire execution
+            double end_time = MPI_Wtime();  // End timing the entire execution
 
-        std::cout << "Total execution time: " << end_time - start_time << " seconds\n";
-        std::cout << "Total sorting time: " << sort_end_time - sort_start_time << " seconds\n";
+            std::cout << "Total execution time: " << end_time - start_time << " seconds\n";
+            std::cout << "Total sorting time: " << sort_end_time - sort_start_time << " seconds\n";
+        }
+        format_result(result, result_size, "hypercube", &opts, numtasks, times.data(), verified,
+                      adaptive ? adapt_engine_name(plan, "hypercube") : "hypercube",
+                      adaptive ? plan.kernel : opts.kernel);
     }
+    stats_stop(&stats);
+
+    stats_report(&stats, MPI_COMM_WORLD, "hypercube", num_elements, opts.stats_file);
 
-    MPI_Finalize();
     return 0;
 }
 
-void hypercube_quicksort(std::vector<int>& B, int d, int id) {
-    MPI_Comm old_comm = MPI_COMM_WORLD;
+/*
+    Reserve the slots hypercube_quicksort() and auto_sort() use for n keys.
+    With shm the keys stay in the shared segment, so the keys / receive
+    ping-pong is only left to grow on overflow, and the send buffer is only
+    needed with off-node partners. The merge slot only serves auto's gather
+    plan on MASTER, and scratch only the kernels that need it.
+*/
+bool hypercube_reserve(sort_arena* arena, long long n, int numtasks, int id, const char* kernel,
+                       const node_shm* shm) {
+    size_t share = n / numtasks + 1;
+    size_t exchanged = 2 * share + numtasks;    // as a PSRS partition; more only when pivots are skewed
+    size_t local = exchanged, merged = 0;
+    if (std::strcmp(kernel, "auto") == 0 && n <= ADAPT_GATHER_MAX_KEYS) {
+        merged = (id == MASTER) ? n + 1 : 1;
+        local = std::max(local, (size_t)n);
+    }
+
+    size_t bytes[NUM_ARENA_SLOTS] = {};
+    bytes[ARENA_KEYS] = (shm == nullptr) ? exchanged * sizeof(int) : 0;
+    bytes[ARENA_RECV] = (shm == nullptr) ? exchanged * sizeof(int) : 0;
+    bytes[ARENA_SEND] = (shm != nullptr && shm->node_size == numtasks) ? 0 : share * sizeof(int);
+    bytes[ARENA_COUNTS] = 2 * numtasks * sizeof(int);
+    bytes[ARENA_MERGE] = merged * sizeof(int);
+    bytes[ARENA_SCRATCH] = kernel_scratch_bytes(kernel, local);
+    return arena_reserve(arena, bytes);
+}
+
+// Sort with the selected local kernel; runs and count use arena scratch
+void local_sort(int* B, int size, const char* kernel, sort_arena* arena) {
+    if (std::strcmp(kernel, "qsort") == 0) {
+        qsort(B, size, sizeof(int), compare_ints);
+    } else if (std::strcmp(kernel, "runs") == 0) {
+        natural_merge_sort(B, size, arena);
+    } else if (std::strcmp(kernel, "count") == 0) {
+        if (!counting_sort(B, size, arena)) {
+            std::sort(B, B + size);
+        }
+    } else {
+        std::sort(B, B + size);
+    }
+}
+
+// cubes[i] is the (i+1)-dimensional subcube of ranks sharing the bits above i
+std::vector<MPI_Comm> make_subcubes(int d, int id) {
+    std::vector<MPI_Comm> cubes(d);
+    for (int i = 0; i < d; ++i) {
+        MPI_Comm_split(MPI_COMM_WORLD, id >> (i + 1), id, &cubes[i]);
+    }
+    return cubes;
+}
+
+/*
+    --shm segment layout for hypercube_quicksort(): two headers, one per
+    round parity (segment half holding B or -1, B's size, the round's send
+    size), then two halves that B and the next round's keys alternate
+    between.
+*/
+int shm_segment_size(int size) {
+    // Room for twice an even share, as a PSRS partition
+    return 2 * SHM_HEADER_INTS + 2 * (2 * size + 64);
+}
+
+int shm_half_capacity(const node_shm* shm) {
+    return (int)((shm->capacity - 2 * SHM_HEADER_INTS) / 2);
+}
+
+int* shm_half(const node_shm* shm, int node_rank, int half) {
+    return node_shm_peer(shm, node_rank) + 2 * SHM_HEADER_INTS + half * shm_half_capacity(shm);
+}
+
+/*
+    Sorts size keys across the hypercube and returns this rank's slice of the
+    global order, valid until the next sort. Without shm, keys is in arena's
+    ARENA_KEYS slot (overwritten) and each round's kept and received halves
+    go into the other of the ARENA_KEYS / ARENA_RECV slots, so no round
+    allocates.
+
+    With shm, keys must be shm_half(shm, node_rank, 0) of a window sized by
+    shm_segment_size(). B then stays in the segment: each round a same-node
+    partner filters its half straight out of this rank's B into its own
+    other half, behind one node barrier. A pair whose keys would not fit
+    the halves falls back to MPI for that round, into the arena.
+
+    If an arena slot cannot grow for this rank or a partner, the pair skips
+    that exchange, the remaining rounds only keep the collectives matched,
+    and nullptr is returned; the caller agrees on failure across ranks.
+*/
+int* hypercube_quicksort(int* keys, int size, int* sorted_size, const std::vector<MPI_Comm>& cubes, int id,
+                         const char* kernel, node_shm* shm, sort_arena* arena, sort_stats* stats) {
+    int d = cubes.size();
+    int* B = keys;
+    int half = (shm != nullptr) ? 0 : -1;   // segment half holding B, -1 if B is in the arena
+    int slot = ARENA_KEYS;                  // arena slot holding B when half < 0
+    int half_capacity = (shm != nullptr) ? shm_half_capacity(shm) : 0;
+    bool failed = false;
 
     for (int i = d - 1; i >= 0; --i) {
         int color = (id >> i) & 1;
 
-        // Split the communicator into two groups
-        MPI_Comm new_comm;
-        MPI_Comm_split(old_comm, color, id, &new_comm);
+        // Pivot is agreed within the subcube, so both partners of this round use it
+        MPI_Comm new_comm = cubes[i];
 
         // Get rank in the new communicator
         int new_rank;
         MPI_Comm_rank(new_comm, &new_rank);
 
         // Group leader selects pivot
+        stats_start(stats, PHASE_PIVOT);
         int pivot;
         if (new_rank == 0) {
             // For simplicity, select median of local data
-            pivot = B[B.size() / 2];
+            pivot = (size == 0) ? INT_MAX : B[size / 2];
         }
 
         // Broadcast pivot within the new communicator
-        MPI_Bcast(&pivot, 1, MPI_INT, 0, new_comm);
-
-        // Partition data based on pivot
-        std::vector<int> B1, B2;
-        for (size_t j = 0; j < B.size(); ++j) {
-            if (B[j] <= pivot)
-                B1.push_back(B[j]);
-            else
-                B2.push_back(B[j]);
+        int group_size;
+        MPI_Comm_size(new_comm, &group_size);
+        if (new_rank == 0) {
+            stats_sent(stats, (double)(group_size - 1) * sizeof(int), group_size - 1);
         }
+        MPI_Bcast(&pivot, 1, MPI_INT, 0, new_comm);
+        stats_stop(stats);
 
         // Determine partner process in the other group
         int partner = id ^ (1 << i);
+        int partner_node = (shm != nullptr) ? shm->node_of[partner] : -1;
+
+        // Partition data based on pivot: color 0 keeps the keys <= pivot and
+        // sends the rest, color 1 the other way round
+        stats_start(stats, PHASE_EXCHANGE);
+        int send_size = 0;
+        for (int j = 0; j < size; ++j) {
+            send_size += ((B[j] <= pivot) == (color == 1));
+        }
+        int keep_size = size - send_size;
+
+        // Publish where B is and what this round sends. Headers alternate by
+        // round, so a partner still reading the last one is never overwritten
+        const int* peer = nullptr;
+        int recv_size = 0;
+        if (shm != nullptr) {
+            int* header = node_shm_local(shm) + (i % 2) * SHM_HEADER_INTS;
+            header[0] = half;
+            header[1] = size;
+            header[2] = send_size;
+            node_shm_publish(shm);
+
+            if (partner_node >= 0) {
+                const int* peer_header = node_shm_peer(shm, partner_node) + (i % 2) * SHM_HEADER_INTS;
+                int peer_keep = peer_header[1] - peer_header[2];
+                recv_size = peer_header[2];
+
+                // Both partners see both headers, so they agree on the path
+                if (half >= 0 && peer_header[0] >= 0 && keep_size + recv_size <= half_capacity &&
+                    peer_keep + send_size <= half_capacity) {
+                    peer = shm_half(shm, partner_node, peer_header[0]);
+                    recv_size = peer_header[1];     // keys to filter, not keys kept
+                }
+            }
+        }
 
-        // Exchange data with partner
-        std::vector<int> send_data, recv_data;
-        int send_size, recv_size;
-
-        if (color == 0) {
-            // Keep B1, send B2
-            send_data = B2;
+        int* next;
+        int next_half = -1;
+        if (peer != nullptr) {
+            next_half = 1 - half;
+            next = shm_half(shm, shm->node_rank, next_half);
         } else {
-            // Keep B2, send B1
-            send_data = B1;
+            // Exchange sizes first, then the send half copied out contiguously
+            MPI_Sendrecv(&send_size, 1, MPI_INT, partner, 0,
+                         &recv_size, 1, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            int* send_data = (int*)arena_get(arena, ARENA_SEND, (send_size + 1) * sizeof(int));
+
+            // Kept keys followed by received ones, in the other segment half
+            // if they fit, else in the arena slot B is not using
+            int next_slot = slot;
+            if (half >= 0 && keep_size + recv_size <= half_capacity) {
+                next_half = 1 - half;
+                next = shm_half(shm, shm->node_rank, next_half);
+            } else {
+                next_slot = (half < 0 && slot == ARENA_RECV) ? ARENA_KEYS : ARENA_RECV;
+                next = (int*)arena_get(arena, next_slot, (keep_size + recv_size + 1) * sizeof(int));
+            }
+
+            // Both partners skip the exchange unless both have their buffers
+            int ready = !failed && send_data != nullptr && next != nullptr, partner_ready;
+            MPI_Sendrecv(&ready, 1, MPI_INT, partner, 0,
+                         &partner_ready, 1, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+            if (!ready || !partner_ready) {
+                failed = true;
+                stats_stop(stats);
+                continue;
+            }
+            slot = next_slot;
+
+            int* send_buf = send_data;
+            for (int j = 0; j < size; ++j) {
+                if ((B[j] <= pivot) == (color == 1))
+                    *send_buf++ = B[j];
+            }
+            stats_sent(stats, (double)send_size * sizeof(int) + sizeof(int), 2);
+            MPI_Sendrecv(send_data, send_size, MPI_INT, partner, 0,
+                         next + keep_size, recv_size, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        }
+        stats_stop(stats);
+
+        // Merge: this rank's kept keys, then (on the shm path) the keys the
+        // partner sends, filtered out of its B with the same test
+        stats_start(stats, PHASE_MERGE);
+        int* keep_buf = next;
+        for (int j = 0; j < size; ++j) {
+            if ((B[j] <= pivot) != (color == 1))
+                *keep_buf++ = B[j];
         }
-        send_size = send_data.size();
+        if (peer != nullptr) {
+            for (int j = 0; j < recv_size; ++j) {
+                if ((peer[j] <= pivot) != (color == 1))
+                    *keep_buf++ = peer[j];
+            }
+        }
+        half = next_half;
+        B = next;
+        size = (peer != nullptr) ? (int)(keep_buf - next) : keep_size + recv_size;
+        stats_stop(stats);
+        stats_exchanged(stats, size);
+    }
 
-        // Exchange sizes first
-        MPI_Sendrecv(&send_size, 1, MPI_INT, partner, 0,
-                     &recv_size, 1, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    if (failed) {
+        return nullptr;
+    }
 
-        // Prepare receive buffer
-        recv_data.resize(recv_size);
+    // Now, each process sorts its local B
+    stats_start(stats, PHASE_LOCAL_SORT);
+    local_sort(B, size, kernel, arena);
+    stats_stop(stats);
 
-        // Exchange data
-        MPI_Sendrecv(send_data.data(), send_size, MPI_INT, partner, 0,
-                     recv_data.data(), recv_size, MPI_INT, partner, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+    *sorted_size = size;
+    return B;
+}
 
-        // Merge received data
-        if (color == 0) {
-            B = B1;
-        } else {
-            B = B2;
-        }
-        B.insert(B.end(), recv_data.begin(), recv_data.end());
+/*
+    --kernel auto: profile the keys across ranks and sort them the way
+    adapt_plan() picks, possibly without any exchange. Same contract as
+    hypercube_quicksort(); leaves the measurements and the decision in
+    *profile and *plan.
+*/
+int* auto_sort(int* keys, int size, int* sorted_size, const std::vector<MPI_Comm>& cubes, int id,
+               node_shm* shm, sort_arena* arena, sort_stats* stats, adapt_profile* profile, adapt_decision* plan) {
+    int numtasks = 1 << cubes.size();
+
+    stats_start(stats, PHASE_PROFILE);
+    adapt_profile_keys(keys, size, MPI_COMM_WORLD, profile);
+    *plan = adapt_plan(profile, numtasks, "std", "std");
+    stats_stop(stats);
+
+    if (plan->engine == ADAPT_PARALLEL) {
+        return hypercube_quicksort(keys, size, sorted_size, cubes, id, plan->kernel, shm, arena, stats);
+    }
 
-        // Free the communicator
-        MPI_Comm_free(&new_comm);
+    // Gather: MASTER sorts everything; ordered: every slice just sorts itself
+    int* B = keys;
+    *sorted_size = size;
+    if (plan->engine == ADAPT_GATHER) {
+        stats_start(stats, PHASE_EXCHANGE);
+        if (id != MASTER) {
+            stats_sent(stats, (double)size * sizeof(int), 1);
+        }
+        *sorted_size = (id == MASTER) ? (int)profile->n : 0;
+        B = (int*)arena_get(arena, ARENA_MERGE, (*sorted_size + 1) * sizeof(int));
+        bool gathered = gather_to_master(keys, size, B, arena, MPI_COMM_WORLD);
+        stats_stop(stats);
+        if (!gathered) {
+            return nullptr;
+        }
     }
 
-    // Now, each process sorts its local B
-    std::sort(B.begin(), B.end());
+    stats_start(stats, PHASE_LOCAL_SORT);
+    local_sort(B, *sorted_size, plan->kernel, arena);
+    stats_stop(stats);
+    return B;
 }
 
 // Function to parse input file of format "{ number, number, ... }"
@@ -2,6 +2,10 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include "sort_bench.h"
+#include "gen_keys.h"
+#include "sort_verify.h"
 
 #define MASTER 0        /* task id of master task */
 #define MAXNUMBER 500   /* maximum number for random array generation */
@@ -11,7 +15,7 @@ void swap(int* a, int* b);
 int partition(int arr[], int low, int high);
 void quickSort(int arr[], int low, int high);
 void printArray(int arr[], int size, bool demo_mode);
-int* create_array(int size);
+void local_sort(int arr[], int size, const char *kernel);
 
 // Main function
 int main(int argc, char *argv[])
@@ -20,45 +24,99 @@ int main(int argc, char *argv[])
     int numtasks;       /* number of tasks */
     bool demo_mode = false; // Toggle between demo and test modes
 
-    int data_size = 1000;  // Size of the random array
     double start, end;
 
+    // Defaults: 1000 random keys in [0, MAXNUMBER]
+    sort_opts opts = {0};
+    opts.n = 1000;
+    opts.dist = DIST_UNIFORM;
+    opts.max_value = MAXNUMBER;
+    opts.skew = 1.0;
+    opts.seed = 1;
+    opts.kernel = "quick";
+    opts.repeat = 1;
+
     /* Obtain number of tasks and task ID */
     MPI_Init(&argc, &argv);
     MPI_Comm_size(MPI_COMM_WORLD, &numtasks);
     MPI_Comm_rank(MPI_COMM_WORLD, &taskid);
 
-    printf("MPI task %d has started...\n", taskid);
-
-    MPI_Barrier(MPI_COMM_WORLD);
-    if (taskid == MASTER)
-        start = MPI_Wtime();
+    if (!parse_sort_opts(argc, argv, &opts, taskid == MASTER) || opts.n < 1 ||
+        (strcmp(opts.kernel, "quick") != 0 && strcmp(opts.kernel, "qsort") != 0)) {
+        if (taskid == MASTER) {
+            fprintf(stderr, "Usage: quicksort_seq [--n N] [--dist D] [--max M] [--skew Z] [--seed S] [--kernel quick|qsort]\n"
+                            "                     [--warmup W] [--repeat R] [--quiet]\n");
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    int data_size = opts.n;  // Size of the random array
 
-    // Generate a random array instead of using a hard-coded array
-    int* random_array_seq = create_array(data_size);
+    if (!opts.quiet) {
+        printf("MPI task %d has started...\n", taskid);
+    }
 
-    // Main sorting section
+    // Only MASTER sorts; the other tasks just wait at the barriers
+    int* random_array_seq = NULL;
+    int* sorted = NULL;
+    double *times = (double *)malloc(opts.repeat * sizeof(double));
+    int local_size = (taskid == MASTER) ? data_size : 0;
+    key_digest input_digest = {0, 0, 0, 0};
     if (taskid == MASTER) {
-        printf("\nUnsorted array: ");
-        printArray(random_array_seq, data_size, demo_mode);
+        random_array_seq = create_input(&opts);
+        sorted = (int *)malloc(data_size * sizeof(int));
+        digest_keys(&input_digest, random_array_seq, data_size);
+    }
 
-        quickSort(random_array_seq, 0, data_size - 1);
+    // Warm-up runs first, then the timed ones
+    for (int run = -opts.warmup; run < opts.repeat; run++) {
+        MPI_Barrier(MPI_COMM_WORLD);
+        start = MPI_Wtime();
+
+        if (taskid == MASTER) {
+            memcpy(sorted, random_array_seq, data_size * sizeof(int));
+            local_sort(sorted, data_size, opts.kernel);
+        }
 
-        printf("\nSorted array: ");
-        printArray(random_array_seq, data_size, demo_mode);
+        MPI_Barrier(MPI_COMM_WORLD);
+        end = MPI_Wtime();
+        if (run >= 0) {
+            times[run] = end - start;
+        }
     }
 
-    MPI_Barrier(MPI_COMM_WORLD);
+    bool verified = verify_sorted(&input_digest, sorted, local_size, MPI_COMM_WORLD);
+
     if (taskid == MASTER) {
-        end = MPI_Wtime();
-        printf("Runtime = %f\n", end - start);
+        if (!opts.quiet) {
+            printf("\nUnsorted array: ");
+            printArray(random_array_seq, data_size, demo_mode);
+
+            printf("\nSorted array: ");
+            printArray(sorted, data_size, demo_mode);
+
+            printf("Runtime = %f\n", times[opts.repeat - 1]);
+        }
+        print_result("seq", &opts, numtasks, times, verified);
     }
 
     MPI_Finalize();
+    free(times);
+    free(sorted);
     free(random_array_seq);  // Free dynamically allocated memory
     return 0;
 }
 
+// Sort with the selected local kernel
+void local_sort(int arr[], int size, const char *kernel)
+{
+    if (strcmp(kernel, "qsort") == 0) {
+        qsort(arr, size, sizeof(int), compare_ints);
+    } else {
+        quickSort(arr, 0, size - 1);
+    }
+}
+
 /*
     Code below is from the website https://www.geeksforgeeks.org/quick-sort/
 */
@@ -116,12 +174,3 @@ void printArray(int arr[], int size, bool demo_mode)
     }
 }
 
-// Function to create an array of random numbers
-int* create_array(int size) {
-    int* numbers = (int *)malloc(size * sizeof(int));
-    for (int i = 0; i < size; i++) {
-        numbers[i] = rand() % (MAXNUMBER + 1);
-    }
-    return numbers;
-}
-
@@ -0,0 +1,228 @@
+/*
+    Adaptive engine and kernel selection ("--kernel auto").
+
+    adapt_profile_keys() measures the distributed input in one streaming pass
+    per rank plus a small sorted sample: monotone run count, share of adjacent
+    pairs already in order, key range, sampled duplicate ratio, and whether
+    rank order is already key order. adapt_plan() turns that into a plan
+    every rank agrees on:
+
+      ordered   slices are already globally ordered, sort locally, no exchange
+      gather    input too small to be worth an exchange, sort it on MASTER
+      parallel  the driver's own engine (PSRS or hypercube)
+
+    with a local kernel of "runs" (natural_merge_sort), "count" (counting
+    sort over the key range) or the driver's fast / robust comparison sort.
+    The ADAPT_* thresholds below are what adapt_log() lines are for tuning;
+    the plan itself also ends the RESULT line (plan_engine plan_kernel).
+*/
+#ifndef SORT_ADAPT_H
+#define SORT_ADAPT_H
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <limits.h>
+#include "sort_bench.h"
+#include "sort_merge.h"
+#include "sort_arena.h"
+
+#ifndef MASTER
+#define MASTER 0
+#endif
+
+#define ADAPT_SAMPLE 256                /* keys per rank for the duplicate estimate */
+#define ADAPT_GATHER_MAX_KEYS 20000     /* below this, one rank sorts everything */
+#define ADAPT_MIN_RUN_LENGTH 32         /* mean run length that makes "runs" pay off */
+#define ADAPT_COUNT_RANGE 2             /* "count" if key range <= this * keys per rank */
+#define ADAPT_MAX_DUPLICATES 0.05       /* above this the fast kernel may degrade */
+#define ADAPT_RANDOM_ORDER 0.2          /* in-order share within 0.5 +- this looks random */
+
+enum adapt_engine {
+    ADAPT_ORDERED,
+    ADAPT_GATHER,
+    ADAPT_PARALLEL
+};
+
+typedef struct {
+    long long n;            /* keys over all ranks */
+    long long runs;         /* monotone runs, summed over ranks */
+    long long pairs;        /* adjacent pairs within slices */
+    long long in_order;     /* of those, how many are already non-decreasing */
+    int min, max;           /* key range */
+    double duplicates;      /* sampled share of keys equal to a neighbour */
+    bool ordered;           /* every slice's keys >= all keys on earlier ranks */
+} adapt_profile;
+
+typedef struct {
+    int engine;
+    const char* kernel;
+} adapt_decision;
+
+/*
+    Counting sort over [min, max] of arr, with the count table in arena's
+    ARENA_SCRATCH slot. Returns false, leaving arr as it was, when the range
+    is too wide for the table to be worth it or the table does not fit.
+*/
+static inline bool counting_sort(int* arr, int size, sort_arena* arena)
+{
+    if (size < 2) {
+        return true;
+    }
+    int mn = arr[0], mx = arr[0];
+    for (int i = 1; i < size; i++) {
+        mn = (arr[i] < mn) ? arr[i] : mn;
+        mx = (arr[i] > mx) ? arr[i] : mx;
+    }
+    long long range = (long long)mx - mn + 1;
+    if (range > 2LL * size + 1024) {
+        return false;
+    }
+
+    int* counts = (int*)arena_get(arena, ARENA_SCRATCH, range * sizeof(int));
+    if (counts == NULL) {
+        return false;
+    }
+    memset(counts, 0, range * sizeof(int));
+    for (int i = 0; i < size; i++) {
+        counts[arr[i] - mn]++;
+    }
+    int* out = arr;
+    for (long long k = 0; k < range; k++) {
+        for (int c = counts[k]; c > 0; c--) {
+            *out++ = (int)(mn + k);
+        }
+    }
+    return true;
+}
+
+// ARENA_SCRATCH bytes the local kernel may need to sort size keys
+static inline size_t kernel_scratch_bytes(const char* kernel, long long size)
+{
+    // natural_merge_sort: a buffer and the run starts; counting_sort: a
+    // table over a range it only accepts up to 2 * size + 1024 wide
+    if (strcmp(kernel, "runs") == 0 || strcmp(kernel, "count") == 0 || strcmp(kernel, "auto") == 0) {
+        return (2 * (size_t)size + 1025) * sizeof(int);
+    }
+    return 0;
+}
+
+// Collective over comm: measure this rank's slice and combine across ranks
+static inline void adapt_profile_keys(const int* keys, int count, MPI_Comm comm, adapt_profile* p)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Runs as natural_run_end() cuts them: a run's first pair sets its
+    // direction (0 until it has one), and the first pair against it ends it
+    long long local[4] = { count, count > 0, count > 0 ? count - 1 : 0, 0 };
+    int local_min = (count > 0) ? keys[0] : INT_MAX, local_max = (count > 0) ? keys[0] : INT_MIN;
+    int direction = 0;
+    for (int i = 1; i < count; i++) {
+        int prev = keys[i - 1], key = keys[i];
+        local_min = (key < local_min) ? key : local_min;
+        local_max = (key > local_max) ? key : local_max;
+        local[3] += (prev <= key);
+        if (direction == 0) {
+            direction = (key < prev) ? -1 : 1;
+        } else if ((direction > 0) ? (key < prev) : (key > prev)) {
+            local[1]++;
+            direction = 0;
+        }
+    }
+
+    // Duplicates among a strided sample, once sorted
+    int sample[ADAPT_SAMPLE];
+    int sample_size = (count < ADAPT_SAMPLE) ? count : ADAPT_SAMPLE;
+    for (int i = 0; i < sample_size; i++) {
+        sample[i] = keys[(long long)i * count / sample_size];
+    }
+    qsort(sample, sample_size, sizeof(int), compare_ints);
+    double dup[2] = { 0, (double)sample_size };
+    for (int i = 1; i < sample_size; i++) {
+        if (sample[i] == sample[i - 1]) {
+            dup[0]++;
+        }
+    }
+
+    // Rank order is key order if no earlier rank holds a larger key
+    int earlier_max = INT_MIN;
+    MPI_Exscan(&local_max, &earlier_max, 1, MPI_INT, MPI_MAX, comm);
+    if (rank == 0) {
+        earlier_max = INT_MIN;
+    }
+    int local_ordered = (count == 0 || local_min >= earlier_max), ordered;
+
+    long long total[4];
+    double dup_total[2];
+    MPI_Allreduce(local, total, 4, MPI_LONG_LONG, MPI_SUM, comm);
+    MPI_Allreduce(dup, dup_total, 2, MPI_DOUBLE, MPI_SUM, comm);
+    MPI_Allreduce(&local_min, &p->min, 1, MPI_INT, MPI_MIN, comm);
+    MPI_Allreduce(&local_max, &p->max, 1, MPI_INT, MPI_MAX, comm);
+    MPI_Allreduce(&local_ordered, &ordered, 1, MPI_INT, MPI_MIN, comm);
+
+    p->n = total[0];
+    p->runs = total[1];
+    p->pairs = total[2];
+    p->in_order = total[3];
+    p->duplicates = (dup_total[1] > 0) ? dup_total[0] / dup_total[1] : 0;
+    p->ordered = ordered;
+}
+
+/*
+    Same on every rank, since the profile is. fast_kernel is the driver's
+    quickest comparison sort on random keys, robust_kernel the one that
+    stays O(n log n) on duplicates and partial order.
+*/
+static inline adapt_decision adapt_plan(const adapt_profile* p, int ranks,
+                                        const char* fast_kernel, const char* robust_kernel)
+{
+    adapt_decision plan;
+    double in_order = (p->pairs > 0) ? (double)p->in_order / p->pairs : 1.0;
+    long long range = (p->n > 0) ? (long long)p->max - p->min + 1 : 0;
+    long long per_rank = p->n / ranks + 1;
+
+    if (p->ordered) {
+        plan.engine = ADAPT_ORDERED;
+    } else if (p->n <= ADAPT_GATHER_MAX_KEYS) {
+        plan.engine = ADAPT_GATHER;
+        per_rank = p->n;
+    } else {
+        plan.engine = ADAPT_PARALLEL;
+    }
+
+    if (p->runs * ADAPT_MIN_RUN_LENGTH <= p->n) {
+        plan.kernel = "runs";
+    } else if (range <= ADAPT_COUNT_RANGE * per_rank) {
+        plan.kernel = "count";
+    } else if (p->duplicates <= ADAPT_MAX_DUPLICATES &&
+               in_order > 0.5 - ADAPT_RANDOM_ORDER && in_order < 0.5 + ADAPT_RANDOM_ORDER) {
+        plan.kernel = fast_kernel;
+    } else {
+        plan.kernel = robust_kernel;
+    }
+    return plan;
+}
+
+// Name of the plan's engine; parallel_engine is the driver's own
+static inline const char* adapt_engine_name(adapt_decision plan, const char* parallel_engine)
+{
+    static const char* const engine_names[3] = { "ordered", "gather", NULL };
+    return (plan.engine == ADAPT_PARALLEL) ? parallel_engine : engine_names[plan.engine];
+}
+
+// MASTER prints the decision and the measurements behind it
+static inline void adapt_log(const adapt_profile* p, adapt_decision plan, const char* parallel_engine, int rank)
+{
+    if (rank != MASTER) {
+        return;
+    }
+    printf("AUTO engine %s kernel %s n %lld runs %lld in_order %.4f range %d..%d duplicates %.4f\n",
+           adapt_engine_name(plan, parallel_engine), plan.kernel,
+           p->n, p->runs, (p->pairs > 0) ? (double)p->in_order / p->pairs : 1.0,
+           p->min, p->max, p->duplicates);
+}
+
+#endif
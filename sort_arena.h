@@ -0,0 +1,177 @@
+/*
+    Per-rank buffer arena for the sort drivers.
+
+    Every buffer a sort needs has a fixed role (slot): the working keys, the
+    samples and pivots, the per-rank counts, send, receive and merge storage,
+    and kernel scratch. A slot keeps its memory between phases and between
+    sorts, so after arena_reserve() has sized the slots a sort uses (each
+    driver knows which, per engine and kernel) the timed runs do no
+    allocation and take no page faults. Slots are page-aligned mmap()
+    regions, prefaulted on growth and optionally backed by transparent huge
+    pages.
+
+    arena_reserve() also releases slots the next sort does not need, so one
+    large service job does not pin its memory. The job's --arena-limit caps
+    the reservation and any growth during the sort (skewed partitions):
+    arena_get() fails instead, and the drivers fail the job on every rank.
+    arena_bytes() is this rank's footprint, reported with the peak and the
+    limit as memory.arena*.
+
+    Growing a slot discards its contents, so callers only ask a slot for a
+    larger size while what it holds is dead.
+*/
+#ifndef SORT_ARENA_H
+#define SORT_ARENA_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ARENA_HUGE_PAGE (2 << 20)
+
+enum arena_slot {
+    ARENA_KEYS,         /* this rank's working copy of its slice */
+    ARENA_SAMPLES,      /* regular samples, gathered samples, pivots */
+    ARENA_COUNTS,       /* per-rank counts / offsets and merge run lists */
+    ARENA_SEND,
+    ARENA_RECV,
+    ARENA_MERGE,        /* merged output of the exchange */
+    ARENA_SCRATCH,      /* temporary storage inside the local kernels */
+    NUM_ARENA_SLOTS
+};
+
+typedef struct {
+    void* base[NUM_ARENA_SLOTS];
+    size_t capacity[NUM_ARENA_SLOTS];   /* bytes */
+    bool huge_pages;
+    size_t limit;       /* bytes the slots may hold together, 0 = no limit */
+    size_t peak;        /* most bytes held since arena_reserve() */
+} sort_arena;
+
+static inline void arena_init(sort_arena* a, bool huge_pages)
+{
+    memset(a, 0, sizeof(*a));
+    a->huge_pages = huge_pages;
+}
+
+static inline void arena_free(sort_arena* a)
+{
+    for (int i = 0; i < NUM_ARENA_SLOTS; i++) {
+        if (a->base[i] != NULL) {
+            munmap(a->base[i], a->capacity[i]);
+        }
+    }
+    memset(a->base, 0, sizeof(a->base));
+    memset(a->capacity, 0, sizeof(a->capacity));
+}
+
+// Bytes this rank holds in the arena
+static inline size_t arena_bytes(const sort_arena* a)
+{
+    size_t total = 0;
+    for (int i = 0; i < NUM_ARENA_SLOTS; i++) {
+        total += a->capacity[i];
+    }
+    return total;
+}
+
+// bytes rounded up to the arena's page size
+static inline size_t arena_round(const sort_arena* a, size_t bytes)
+{
+    size_t unit = a->huge_pages ? ARENA_HUGE_PAGE : (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + unit - 1) / unit * unit;
+}
+
+/*
+    Apply a job's options before its arena_reserve(). Switching the page
+    size releases the slots (they are remapped on their next use).
+*/
+static inline void arena_configure(sort_arena* a, bool huge_pages, size_t limit)
+{
+    if (a->huge_pages != huge_pages) {
+        arena_free(a);
+        a->huge_pages = huge_pages;
+    }
+    a->limit = limit;
+}
+
+/*
+    Slot buffer of at least bytes. Reuses the slot's memory when it fits;
+    otherwise remaps it 1.5x larger, or just large enough near the limit
+    (contents lost). NULL if that would pass the limit or memory runs out,
+    in which case the slot keeps its old memory.
+*/
+static inline void* arena_get(sort_arena* a, int slot, size_t bytes)
+{
+    if (bytes <= a->capacity[slot] && a->base[slot] != NULL) {
+        return a->base[slot];
+    }
+
+    size_t grown = a->capacity[slot] + a->capacity[slot] / 2;
+    size_t size = arena_round(a, (bytes > grown) ? bytes : grown);
+    size_t others = arena_bytes(a) - a->capacity[slot];
+    if (a->limit > 0 && others + size > a->limit) {
+        size = arena_round(a, bytes);
+        if (others + size > a->limit) {
+            return NULL;
+        }
+    }
+
+    // Map the new region before letting go of the old one
+    void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return NULL;
+    }
+    if (a->base[slot] != NULL) {
+        munmap(a->base[slot], a->capacity[slot]);
+    }
+#ifdef MADV_HUGEPAGE
+    if (a->huge_pages) {
+        madvise(base, size, MADV_HUGEPAGE);
+    }
+#endif
+    // Fault every page in now rather than during a timed sort
+    memset(base, 0, size);
+
+    a->base[slot] = base;
+    a->capacity[slot] = size;
+    if (arena_bytes(a) > a->peak) {
+        a->peak = arena_bytes(a);
+    }
+    return base;
+}
+
+/*
+    Size the slots for one sort before its timed runs: slot i gets at least
+    bytes[i] (0 if the sort does not use it). Slots holding more than twice
+    what the sort asks for are released first, and the peak starts over from
+    what is left. Returns false if the total is over the limit or memory
+    runs out; the arena stays usable either way.
+*/
+static inline bool arena_reserve(sort_arena* a, const size_t bytes[NUM_ARENA_SLOTS])
+{
+    size_t total = 0;
+    for (int i = 0; i < NUM_ARENA_SLOTS; i++) {
+        if (a->base[i] != NULL && a->capacity[i] > 2 * arena_round(a, bytes[i])) {
+            munmap(a->base[i], a->capacity[i]);
+            a->base[i] = NULL;
+            a->capacity[i] = 0;
+        }
+        total += (bytes[i] > a->capacity[i]) ? arena_round(a, bytes[i]) : a->capacity[i];
+    }
+    a->peak = arena_bytes(a);
+    if (a->limit > 0 && total > a->limit) {
+        return false;
+    }
+
+    for (int i = 0; i < NUM_ARENA_SLOTS; i++) {
+        if (bytes[i] > 0 && arena_get(a, i, bytes[i]) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
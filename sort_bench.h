@@ -0,0 +1,182 @@
+/*
+    Command-line options and result reporting shared by the sort drivers, so
+    bench.py can run every engine over the same grid. The inputs themselves
+    come from gen_keys.h and the output check from sort_verify.h.
+
+    Each driver prints one "RESULT ..." line on MASTER that bench.py parses:
+    RESULT engine kernel dist n ranks repeat median_s min_s max_s verified
+           plan_engine plan_kernel
+    where the plan is what actually ran. It only differs from engine and
+    kernel under --kernel auto (see sort_adapt.h).
+*/
+#ifndef SORT_BENCH_H
+#define SORT_BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+enum input_dist {
+    DIST_UNIFORM,
+    DIST_SORTED,
+    DIST_REVERSED,
+    DIST_FEW_UNIQUE,
+    DIST_ZIPF,
+    DIST_ORGAN_PIPE,
+    NUM_DISTS
+};
+
+static const char* const input_dist_names[NUM_DISTS] = {
+    "uniform", "sorted", "reversed", "few-unique", "zipf", "organ-pipe"
+};
+
+typedef struct {
+    int n;                  /* number of keys, 0 = driver's built-in input */
+    int dist;
+    int max_value;          /* keys are drawn from [0, max_value] */
+    double skew;            /* zipf exponent */
+    unsigned seed;
+    const char* kernel;     /* local sort kernel, checked by the driver */
+    int warmup;             /* untimed runs before the measured ones */
+    int repeat;             /* measured runs, the median is reported */
+    bool quiet;             /* skip gathering and printing the arrays */
+    bool shm;               /* exchange within a node through shared memory */
+    bool huge_pages;        /* back the sort buffers with huge pages, see sort_arena.h */
+    int arena_limit;        /* MB of sort buffers a rank may reserve, 0 = no limit */
+    const char* input_file;
+    const char* shards;     /* binary shard prefix, see gen_keys.h */
+    const char* text_file;  /* C-array text output (gen_keys only) */
+    const char* stats_file;
+    const char* serve;      /* run as a service on this socket, see sort_service.h */
+} sort_opts;
+
+/*
+    Fills o from argv on top of the defaults already in it. Returns false on
+    an unknown option or value, and prints the problem if report is set (one
+    rank reports for all of them).
+*/
+static inline bool parse_sort_opts(int argc, char* argv[], sort_opts* o, bool report)
+{
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--quiet") == 0) {
+            o->quiet = true;
+            continue;
+        }
+        if (strcmp(arg, "--shm") == 0) {
+            o->shm = true;
+            continue;
+        }
+        if (strcmp(arg, "--huge-pages") == 0) {
+            o->huge_pages = true;
+            continue;
+        }
+        if (val == NULL) {
+            if (report) {
+                fprintf(stderr, "Missing value for %s\n", arg);
+            }
+            return false;
+        }
+        i++;
+
+        if (strcmp(arg, "--n") == 0) {
+            o->n = atoi(val);
+        } else if (strcmp(arg, "--max") == 0) {
+            o->max_value = atoi(val);
+        } else if (strcmp(arg, "--skew") == 0) {
+            o->skew = atof(val);
+        } else if (strcmp(arg, "--seed") == 0) {
+            o->seed = (unsigned)strtoul(val, NULL, 10);
+        } else if (strcmp(arg, "--kernel") == 0) {
+            o->kernel = val;
+        } else if (strcmp(arg, "--warmup") == 0) {
+            o->warmup = atoi(val);
+        } else if (strcmp(arg, "--repeat") == 0) {
+            o->repeat = atoi(val);
+        } else if (strcmp(arg, "--arena-limit") == 0) {
+            o->arena_limit = atoi(val);
+        } else if (strcmp(arg, "--input") == 0) {
+            o->input_file = val;
+        } else if (strcmp(arg, "--shards") == 0) {
+            o->shards = val;
+        } else if (strcmp(arg, "--text") == 0) {
+            o->text_file = val;
+        } else if (strcmp(arg, "--stats") == 0) {
+            o->stats_file = val;
+        } else if (strcmp(arg, "--serve") == 0) {
+            o->serve = val;
+        } else if (strcmp(arg, "--dist") == 0) {
+            o->dist = -1;
+            for (int d = 0; d < NUM_DISTS; d++) {
+                if (strcmp(val, input_dist_names[d]) == 0) {
+                    o->dist = d;
+                }
+            }
+            if (o->dist < 0) {
+                if (report) {
+                    fprintf(stderr, "Unknown distribution: %s\n", val);
+                }
+                return false;
+            }
+        } else {
+            if (report) {
+                fprintf(stderr, "Unknown option: %s\n", arg);
+            }
+            return false;
+        }
+    }
+    if (o->n < 0 || o->max_value < 0 || o->skew < 0 || o->warmup < 0 || o->repeat < 1 || o->arena_limit < 0) {
+        if (report) {
+            fprintf(stderr, "Invalid --n, --max, --skew, --warmup, --repeat or --arena-limit\n");
+        }
+        return false;
+    }
+    return true;
+}
+
+// Kernels every parallel driver has, plus its own fast comparison sort
+static inline bool valid_kernel(const char* kernel, const char* fast_kernel)
+{
+    return strcmp(kernel, fast_kernel) == 0 || strcmp(kernel, "qsort") == 0 ||
+           strcmp(kernel, "runs") == 0 || strcmp(kernel, "count") == 0 || strcmp(kernel, "auto") == 0;
+}
+
+static inline int compare_ints(const void* a, const void* b)
+{
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static inline int compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a;
+    double y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts times in place and formats the RESULT line for bench.py into line
+static inline void format_result(char* line, size_t size, const char* engine, const sort_opts* o,
+                                 int ranks, double* times, bool verified,
+                                 const char* plan_engine, const char* plan_kernel)
+{
+    qsort(times, o->repeat, sizeof(double), compare_doubles);
+    double median = (o->repeat % 2) ? times[o->repeat / 2]
+                                    : (times[o->repeat / 2 - 1] + times[o->repeat / 2]) / 2;
+    snprintf(line, size, "RESULT %s%s %s %s %d %d %d %.9f %.9f %.9f %d %s %s", engine, o->shm ? "-shm" : "",
+             o->kernel, input_dist_names[o->dist], o->n, ranks, o->repeat, median,
+             times[0], times[o->repeat - 1], verified ? 1 : 0, plan_engine, plan_kernel);
+}
+
+static inline void print_result(const char* engine, const sort_opts* o, int ranks,
+                                double* times, bool verified)
+{
+    char line[256];
+    format_result(line, sizeof(line), engine, o, ranks, times, verified, engine, o->kernel);
+    printf("%s\n", line);
+}
+
+#endif
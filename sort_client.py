@@ -0,0 +1,28 @@
+import socket
+import sys
+
+# Send one job to a sort service started with --serve and print the reply.
+#   mpirun -np 4 ./psrs --serve /tmp/psrs.sock &
+#   python3 sort_client.py /tmp/psrs.sock --n 1000000 --dist zipf --kernel qsort
+#   python3 sort_client.py /tmp/psrs.sock shutdown
+
+def send_job(socket_path, job):
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as sock:
+        sock.connect(socket_path)
+        sock.sendall((job + "\n").encode())
+        reply = b""
+        while True:
+            chunk = sock.recv(4096)
+            if not chunk:
+                break
+            reply += chunk
+    return reply.decode()
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print("Usage: sort_client.py SOCKET [job options... | shutdown]")
+        sys.exit(1)
+    reply = send_job(sys.argv[1], " ".join(sys.argv[2:]))
+    print(reply, end="")
+    sys.exit(0 if reply.startswith(("RESULT", "shutdown")) else 1)
@@ -0,0 +1,173 @@
+/*
+    k-way merge of sorted runs, used where a rank ends up holding several
+    already sorted pieces (for example the partitions received in PSRS),
+    and a natural-run merge sort for nearly sorted input.
+*/
+#ifndef SORT_MERGE_H
+#define SORT_MERGE_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "sort_arena.h"
+#include "sort_bench.h"
+
+typedef struct {
+    const int* keys;
+    int count;
+} key_run;
+
+// Restore the min-heap of run indices (ordered by each run's head) below slot i
+static inline void merge_sift_down(int* heap, int size, const key_run* runs, const int* pos, int i)
+{
+    for (;;) {
+        int smallest = i, left = 2 * i + 1, right = 2 * i + 2;
+        if (left < size && runs[heap[left]].keys[pos[heap[left]]] < runs[heap[smallest]].keys[pos[heap[smallest]]]) {
+            smallest = left;
+        }
+        if (right < size && runs[heap[right]].keys[pos[heap[right]]] < runs[heap[smallest]].keys[pos[heap[smallest]]]) {
+            smallest = right;
+        }
+        if (smallest == i) {
+            return;
+        }
+        int t = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = t;
+        i = smallest;
+    }
+}
+
+/*
+    Merge nruns sorted runs into out, which must hold the sum of their
+    counts. The heap lives in arena's ARENA_SCRATCH slot; if that cannot
+    grow, the runs are concatenated and sorted with qsort instead.
+*/
+static inline void merge_runs(const key_run* runs, int nruns, int* out, sort_arena* arena)
+{
+    int* heap = (int*)arena_get(arena, ARENA_SCRATCH, 2 * (nruns + 1) * sizeof(int));
+    if (heap == NULL) {
+        size_t total = 0;
+        for (int r = 0; r < nruns; r++) {
+            memcpy(out + total, runs[r].keys, runs[r].count * sizeof(int));
+            total += runs[r].count;
+        }
+        qsort(out, total, sizeof(int), compare_ints);
+        return;
+    }
+    int* pos = heap + nruns + 1;
+    int size = 0;
+
+    memset(pos, 0, (nruns + 1) * sizeof(int));
+    for (int r = 0; r < nruns; r++) {
+        if (runs[r].count > 0) {
+            heap[size++] = r;
+        }
+    }
+    for (int i = size / 2 - 1; i >= 0; i--) {
+        merge_sift_down(heap, size, runs, pos, i);
+    }
+
+    while (size > 1) {
+        int r = heap[0];
+        *out++ = runs[r].keys[pos[r]++];
+        if (pos[r] == runs[r].count) {
+            heap[0] = heap[--size];
+        }
+        merge_sift_down(heap, size, runs, pos, 0);
+    }
+    if (size == 1) {
+        int r = heap[0];
+        for (int i = pos[r]; i < runs[r].count; i++) {
+            *out++ = runs[r].keys[i];
+        }
+    }
+}
+
+/*
+    End of the monotone run starting at i: a non-decreasing run, or a
+    non-increasing one (*descending set) that can be reversed in place.
+*/
+static inline int natural_run_end(const int* arr, int size, int i, int* descending)
+{
+    int j = i + 1;
+    *descending = (j < size && arr[j] < arr[i]);
+    if (*descending) {
+        while (j < size && arr[j] <= arr[j - 1]) {
+            j++;
+        }
+    } else {
+        while (j < size && arr[j] >= arr[j - 1]) {
+            j++;
+        }
+    }
+    return j;
+}
+
+/*
+    Sort arr by reversing its descending runs and then merging neighbouring
+    runs pairwise until one is left. O(n log r) for r runs, so sorted or
+    reversed input costs a single pass. Uses arena's ARENA_SCRATCH slot, or
+    falls back to qsort if that cannot grow.
+*/
+static inline void natural_merge_sort(int* arr, int size, sort_arena* arena)
+{
+    int nruns = 0, descending;
+    for (int i = 0, end; i < size; i = end) {
+        end = natural_run_end(arr, size, i, &descending);
+        if (descending) {
+            for (int lo = i, hi = end - 1; lo < hi; lo++, hi--) {
+                int t = arr[lo];
+                arr[lo] = arr[hi];
+                arr[hi] = t;
+            }
+        }
+        nruns++;
+    }
+    if (nruns <= 1) {
+        return;
+    }
+
+    // All runs are ascending now (neighbours may have joined, so nruns is
+    // an upper bound); starts[] follows the merge buffer in scratch
+    int* buffer = (int*)arena_get(arena, ARENA_SCRATCH, ((size_t)size + nruns + 1) * sizeof(int));
+    if (buffer == NULL) {
+        // No room for the merge buffer: sort in place instead
+        qsort(arr, size, sizeof(int), compare_ints);
+        return;
+    }
+    int* starts = buffer + size;
+    nruns = 0;
+    for (int i = 0, end; i < size; i = end) {
+        end = natural_run_end(arr, size, i, &descending);
+        starts[nruns++] = i;
+    }
+
+    // Each pass halves the run count, alternating between arr and buffer
+    int* src = arr;
+    int* dst = buffer;
+    while (nruns > 1) {
+        int merged = 0;
+        for (int r = 0; r < nruns; r += 2) {
+            int lo = starts[r];
+            int mid = (r + 1 < nruns) ? starts[r + 1] : size;
+            int hi = (r + 2 < nruns) ? starts[r + 2] : size;
+            int a = lo, b = mid, k = lo;
+            while (a < mid && b < hi) {
+                dst[k++] = (src[b] < src[a]) ? src[b++] : src[a++];
+            }
+            memcpy(dst + k, src + a, (mid - a) * sizeof(int));
+            k += mid - a;
+            memcpy(dst + k, src + b, (hi - b) * sizeof(int));
+            starts[merged++] = lo;
+        }
+        nruns = merged;
+        int* t = src;
+        src = dst;
+        dst = t;
+    }
+    if (src != arr) {
+        memcpy(arr, src, size * sizeof(int));
+    }
+}
+
+#endif
@@ -0,0 +1,204 @@
+/*
+    Persistent sort service: keeps the MPI ranks up between sort jobs so
+    MPI_Init, communicator setup and buffers are paid for once.
+
+    MASTER listens on a Unix socket. A job is one line of the same options
+    the driver takes on the command line ("--n 1000000 --dist zipf"), and
+    the reply is the RESULT line plus the job's latency, or an ERROR line.
+    The line "shutdown" stops the server. See sort_client.py.
+
+    service_run() is the whole server loop; a driver only supplies the
+    function that runs one job.
+*/
+#ifndef SORT_SERVICE_H
+#define SORT_SERVICE_H
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "sort_bench.h"
+
+#ifndef MASTER
+#define MASTER 0
+#endif
+
+#define JOB_MAX_LINE 4096
+#define JOB_MAX_ARGS 64
+
+// MASTER only: listening socket at path, or -1 on error
+static inline int service_open(const char* path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        fprintf(stderr, "Error opening service socket: %s\n", path);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+static inline void service_close(int listen_fd, const char* path)
+{
+    if (listen_fd >= 0) {
+        close(listen_fd);
+        unlink(path);
+    }
+}
+
+/*
+    Collective over comm. MASTER waits for the next client and reads its job
+    line, which is then broadcast so every rank gets it in line. Returns false
+    once a client sends "shutdown" (or MASTER could not listen).
+*/
+static inline bool service_next_job(int listen_fd, int* client_fd, char* line, MPI_Comm comm)
+{
+    int rank, len = 0;
+    MPI_Comm_rank(comm, &rank);
+
+    if (rank == MASTER) {
+        *client_fd = -1;
+        while (listen_fd >= 0 && *client_fd < 0) {
+            *client_fd = accept(listen_fd, NULL, NULL);
+        }
+        if (listen_fd < 0) {
+            strcpy(line, "shutdown");
+        } else {
+            // One line per job; stop at newline, EOF or a full buffer
+            char c;
+            while (len < JOB_MAX_LINE - 1 && read(*client_fd, &c, 1) == 1 && c != '\n') {
+                line[len++] = c;
+            }
+            line[len] = '\0';
+        }
+        len = (int)strlen(line) + 1;
+    }
+    MPI_Bcast(&len, 1, MPI_INT, MASTER, comm);
+    MPI_Bcast(line, len, MPI_CHAR, MASTER, comm);
+    return strcmp(line, "shutdown") != 0;
+}
+
+/*
+    MASTER only: send the reply and close the client connection. Returns
+    false if the client has gone away (EPIPE with SIGPIPE ignored, see
+    service_run()); the server just moves on to the next client.
+*/
+static inline bool service_reply(int client_fd, const char* text)
+{
+    size_t len = strlen(text), sent = 0;
+    while (sent < len) {
+#ifdef MSG_NOSIGNAL
+        ssize_t n = send(client_fd, text + sent, len - sent, MSG_NOSIGNAL);
+#else
+        ssize_t n = write(client_fd, text + sent, len - sent);
+#endif
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        sent += (size_t)n;
+    }
+    close(client_fd);
+    return sent == len;
+}
+
+// Split line in place into argv[1..] (argv[0] is "job"); returns argc
+static inline int job_args(char* line, char** argv)
+{
+    int argc = 0;
+    static char job_name[] = "job";
+
+    argv[argc++] = job_name;
+    for (char* tok = strtok(line, " \t\r"); tok != NULL && argc < JOB_MAX_ARGS; tok = strtok(NULL, " \t\r")) {
+        argv[argc++] = tok;
+    }
+    return argc;
+}
+
+/*
+    Runs one job on every rank of comm: sorts as opts says and leaves the
+    RESULT line in result on MASTER. Returns non-zero (on every rank) if the
+    job's input could not be read.
+*/
+typedef int (*service_job_fn)(sort_opts* opts, void* context, char* result, size_t result_size);
+
+// Whether the driver can run opts; the same answer on every rank
+typedef bool (*service_valid_fn)(const sort_opts* opts);
+
+/*
+    Collective over comm: serve jobs on the socket defaults->serve until a
+    client sends "shutdown". Each job line is parsed on top of defaults,
+    checked with valid and run with run_job(opts, context, ...). Every rank
+    parses the same line, so they all agree on the outcome; only MASTER
+    reports a bad one.
+*/
+static inline void service_run(const sort_opts* defaults, const char* engine, service_valid_fn valid,
+                               service_job_fn run_job, void* context, MPI_Comm comm)
+{
+    int rank, ranks, listen_fd = -1, client_fd = -1, jobs = 0;
+    char line[JOB_MAX_LINE], result[256], reply[512];
+    char* job_argv[JOB_MAX_ARGS];
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    if (rank == MASTER) {
+        // A client that disconnects before its reply must not kill the server
+        signal(SIGPIPE, SIG_IGN);
+        listen_fd = service_open(defaults->serve);
+        if (listen_fd >= 0) {
+            printf("Serving %s jobs on %s with %d tasks\n", engine, defaults->serve, ranks);
+            fflush(stdout);
+        }
+    }
+
+    while (service_next_job(listen_fd, &client_fd, line, comm)) {
+        double start = MPI_Wtime();
+        sort_opts opts = *defaults;
+        opts.serve = NULL;
+        opts.quiet = true;
+
+        int status = 1;
+        int job_argc = job_args(line, job_argv);
+        if (parse_sort_opts(job_argc, job_argv, &opts, rank == MASTER) && opts.serve == NULL && valid(&opts)) {
+            status = run_job(&opts, context, result, sizeof(result));
+        }
+
+        if (rank == MASTER) {
+            if (status == 0) {
+                snprintf(reply, sizeof(reply), "%s latency %.6f\n", result, MPI_Wtime() - start);
+            } else {
+                snprintf(reply, sizeof(reply), "ERROR invalid job or input\n");
+            }
+            printf("job %d: %s", ++jobs, reply);
+            if (!service_reply(client_fd, reply)) {
+                printf("job %d: client disconnected before the reply\n", jobs);
+            }
+            fflush(stdout);
+        }
+    }
+
+    if (rank == MASTER) {
+        if (client_fd >= 0) {
+            service_reply(client_fd, "shutdown\n");
+        }
+        service_close(listen_fd, defaults->serve);
+    }
+}
+
+#endif
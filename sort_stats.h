@@ -0,0 +1,185 @@
+/*
+    Lightweight per-rank instrumentation shared by the parallel sort drivers.
+
+    Every rank records wall time, bytes and messages sent for each phase, its
+    element count after each exchange round and its arena footprint (held,
+    peak and limit).
+    stats_report() reduces these across the communicator to min/max/mean/
+    imbalance on MASTER and writes them as JSON or CSV (picked from the file
+    extension).
+
+    Header-only so it can be included from both the C and C++ drivers.
+*/
+#ifndef SORT_STATS_H
+#define SORT_STATS_H
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef MASTER
+#define MASTER 0
+#endif
+
+#define STATS_MAX_EXCHANGES 32  /* enough for a 2^32 rank hypercube */
+
+enum sort_phase {
+    PHASE_READ,
+    PHASE_SCATTER,
+    PHASE_PROFILE,
+    PHASE_LOCAL_SORT,
+    PHASE_SAMPLING,
+    PHASE_PIVOT,
+    PHASE_EXCHANGE,
+    PHASE_MERGE,
+    PHASE_GATHER,
+    PHASE_WRITE,
+    PHASE_VERIFY,
+    NUM_PHASES
+};
+
+static const char* const sort_phase_names[NUM_PHASES] = {
+    "read", "scatter", "profile", "local_sort", "sampling", "pivot",
+    "exchange", "merge", "gather", "write", "verify"
+};
+
+typedef struct {
+    double time[NUM_PHASES];
+    double bytes_sent[NUM_PHASES];
+    double msgs_sent[NUM_PHASES];
+    double exchange_counts[STATS_MAX_EXCHANGES];
+    int num_exchanges;
+    double arena_bytes;     /* sort buffers held by this rank, see sort_arena.h */
+    double arena_peak;      /* most held during the job */
+    double arena_limit;     /* what the job may reserve, 0 = no limit */
+    int current;            /* phase the next stats_sent() is charged to */
+    double started;
+} sort_stats;
+
+static inline void stats_reset(sort_stats* s)
+{
+    memset(s, 0, sizeof(*s));
+    s->current = PHASE_READ;
+}
+
+static inline void stats_start(sort_stats* s, int phase)
+{
+    s->current = phase;
+    s->started = MPI_Wtime();
+}
+
+static inline void stats_stop(sort_stats* s)
+{
+    s->time[s->current] += MPI_Wtime() - s->started;
+}
+
+// Charge payload sent by this rank to the running phase
+static inline void stats_sent(sort_stats* s, double bytes, int msgs)
+{
+    s->bytes_sent[s->current] += bytes;
+    s->msgs_sent[s->current] += msgs;
+}
+
+// Record how many elements this rank holds after an exchange round
+static inline void stats_exchanged(sort_stats* s, long long count)
+{
+    if (s->num_exchanges < STATS_MAX_EXCHANGES) {
+        s->exchange_counts[s->num_exchanges++] = (double)count;
+    }
+}
+
+#define STATS_NUM_VALUES (3 * NUM_PHASES + STATS_MAX_EXCHANGES + 3)
+
+static inline void stats_write_row(FILE* f, bool json, const char* program, int ranks, long long n,
+                                   const char* metric, double mn, double mx, double sum, bool* first)
+{
+    double mean = sum / ranks;
+    double imbalance = (mean > 0) ? mx / mean : 1.0;
+
+    if (json) {
+        fprintf(f, "%s\n    \"%s\": {\"min\": %g, \"max\": %g, \"mean\": %g, \"imbalance\": %g}",
+                *first ? "" : ",", metric, mn, mx, mean, imbalance);
+    } else {
+        fprintf(f, "%s,%d,%lld,%s,%g,%g,%g,%g\n", program, ranks, n, metric, mn, mx, mean, imbalance);
+    }
+    *first = false;
+}
+
+/*
+    Collective over comm. Does nothing unless path is set; MASTER writes the
+    file, as JSON if path ends in ".json" and CSV otherwise.
+*/
+static inline void stats_report(const sort_stats* s, MPI_Comm comm, const char* program,
+                                long long n, const char* path)
+{
+    double local[STATS_NUM_VALUES], mn[STATS_NUM_VALUES], mx[STATS_NUM_VALUES], sum[STATS_NUM_VALUES];
+    int rank, ranks, num_exchanges;
+
+    if (path == NULL) {
+        return;
+    }
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    memcpy(local, s->time, sizeof(s->time));
+    memcpy(local + NUM_PHASES, s->bytes_sent, sizeof(s->bytes_sent));
+    memcpy(local + 2 * NUM_PHASES, s->msgs_sent, sizeof(s->msgs_sent));
+    memcpy(local + 3 * NUM_PHASES, s->exchange_counts, sizeof(s->exchange_counts));
+    local[STATS_NUM_VALUES - 3] = s->arena_bytes;
+    local[STATS_NUM_VALUES - 2] = s->arena_peak;
+    local[STATS_NUM_VALUES - 1] = s->arena_limit;
+
+    MPI_Reduce(local, mn, STATS_NUM_VALUES, MPI_DOUBLE, MPI_MIN, MASTER, comm);
+    MPI_Reduce(local, mx, STATS_NUM_VALUES, MPI_DOUBLE, MPI_MAX, MASTER, comm);
+    MPI_Reduce(local, sum, STATS_NUM_VALUES, MPI_DOUBLE, MPI_SUM, MASTER, comm);
+    MPI_Reduce(&s->num_exchanges, &num_exchanges, 1, MPI_INT, MPI_MAX, MASTER, comm);
+
+    if (rank != MASTER) {
+        return;
+    }
+
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "Error writing stats file: %s\n", path);
+        return;
+    }
+
+    size_t len = strlen(path);
+    bool json = len >= 5 && strcmp(path + len - 5, ".json") == 0;
+    bool first = true;
+    char metric[64];
+
+    if (json) {
+        fprintf(f, "{\n  \"program\": \"%s\",\n  \"ranks\": %d,\n  \"n\": %lld,\n  \"metrics\": {",
+                program, ranks, n);
+    } else {
+        fprintf(f, "program,ranks,n,metric,min,max,mean,imbalance\n");
+    }
+
+    static const char* const kinds[3] = { "time", "bytes_sent", "msgs_sent" };
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < NUM_PHASES; i++) {
+            int j = k * NUM_PHASES + i;
+            snprintf(metric, sizeof(metric), "%s.%s", kinds[k], sort_phase_names[i]);
+            stats_write_row(f, json, program, ranks, n, metric, mn[j], mx[j], sum[j], &first);
+        }
+    }
+    for (int i = 0; i < num_exchanges; i++) {
+        int j = 3 * NUM_PHASES + i;
+        snprintf(metric, sizeof(metric), "count.exchange%d", i);
+        stats_write_row(f, json, program, ranks, n, metric, mn[j], mx[j], sum[j], &first);
+    }
+    static const char* const memory[3] = { "memory.arena", "memory.arena_peak", "memory.arena_limit" };
+    for (int i = 0; i < 3; i++) {
+        int j = STATS_NUM_VALUES - 3 + i;
+        stats_write_row(f, json, program, ranks, n, memory[i], mn[j], mx[j], sum[j], &first);
+    }
+
+    if (json) {
+        fprintf(f, "\n  }\n}\n");
+    }
+    fclose(f);
+}
+
+#endif
@@ -0,0 +1,140 @@
+/*
+    Distributed output verification in O(n/p) per rank.
+
+    A run is correct when every rank's output slice is sorted, no rank's first
+    key is below a key on a lower rank, and the output is a permutation of the
+    input. The last is checked with order-independent digests (count, sum,
+    xor and sum of hashed keys) reduced over the communicator, so nothing is
+    gathered and the check is cheap enough to leave on.
+*/
+#ifndef SORT_VERIFY_H
+#define SORT_VERIFY_H
+
+#include "mpi.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <limits.h>
+#include "gen_keys.h"
+#include "sort_arena.h"
+
+#define DIGEST_SALT 0x5851F42D4C957F2DULL
+
+typedef struct {
+    uint64_t count;
+    uint64_t sum;       /* plain key sum, mod 2^64 */
+    uint64_t hash_sum;  /* multiset hash: sum of mixed keys */
+    uint64_t hash_xor;
+} key_digest;
+
+// Order-independent digest of a slice; call again to add more keys
+static inline void digest_keys(key_digest* d, const int* keys, int count)
+{
+    for (int i = 0; i < count; i++) {
+        uint64_t h = mix64((uint64_t)(uint32_t)keys[i] ^ DIGEST_SALT);
+        d->sum += (uint64_t)(int64_t)keys[i];
+        d->hash_sum += h;
+        d->hash_xor ^= mix64(h);
+    }
+    d->count += count;
+}
+
+/*
+    Collective over comm. input is this rank's digest of the keys it started
+    with, output/out_count its slice of the result. Returns the same verdict
+    on every rank and reports the first problem found on stderr.
+*/
+static inline bool verify_sorted(const key_digest* input, const int* output, int out_count,
+                                 MPI_Comm comm)
+{
+    int rank;
+    MPI_Comm_rank(comm, &rank);
+
+    // Local order
+    int ok = 1;
+    for (int i = 1; i < out_count; i++) {
+        if (output[i - 1] > output[i]) {
+            fprintf(stderr, "Verify: rank %d slice not sorted at %d\n", rank, i);
+            ok = 0;
+            break;
+        }
+    }
+
+    // Boundaries: compare the first key with the largest key on lower ranks,
+    // which also covers ranks that ended up with an empty slice
+    int last = (out_count > 0) ? output[out_count - 1] : INT_MIN;
+    int lower_max = INT_MIN;
+    MPI_Exscan(&last, &lower_max, 1, MPI_INT, MPI_MAX, comm);
+    if (rank == 0) {
+        lower_max = INT_MIN;
+    }
+    if (out_count > 0 && output[0] < lower_max) {
+        fprintf(stderr, "Verify: rank %d starts below a key on a lower rank\n", rank);
+        ok = 0;
+    }
+
+    // Permutation: reduce input and output digests
+    key_digest out = {0, 0, 0, 0};
+    digest_keys(&out, output, out_count);
+
+    uint64_t local_sums[6] = { input->count, input->sum, input->hash_sum,
+                               out.count, out.sum, out.hash_sum };
+    uint64_t local_xors[2] = { input->hash_xor, out.hash_xor };
+    uint64_t sums[6], xors[2];
+    MPI_Allreduce(local_sums, sums, 6, MPI_UINT64_T, MPI_SUM, comm);
+    MPI_Allreduce(local_xors, xors, 2, MPI_UINT64_T, MPI_BXOR, comm);
+
+    if (sums[0] != sums[3] || sums[1] != sums[4] || sums[2] != sums[5] || xors[0] != xors[1]) {
+        if (rank == 0) {
+            fprintf(stderr, "Verify: output is not a permutation of the input "
+                            "(%llu keys in, %llu out)\n",
+                    (unsigned long long)sums[0], (unsigned long long)sums[3]);
+        }
+        ok = 0;
+    }
+
+    int all_ok;
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, comm);
+    return all_ok != 0;
+}
+
+/*
+    Collective over comm: concatenate every rank's slice into all on MASTER,
+    which must have room for them all. The counts and offsets live in
+    arena's ARENA_COUNTS slot. Returns false on every rank, with nothing
+    gathered, if MASTER could not get the counts or has no output buffer.
+*/
+static inline bool gather_to_master(const int* local, int local_size, int* all, sort_arena* arena,
+                                    MPI_Comm comm)
+{
+    int rank, ranks, ok = 1;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &ranks);
+
+    int* counts = NULL;
+    if (rank == MASTER) {
+        counts = (int*)arena_get(arena, ARENA_COUNTS, 2 * (size_t)ranks * sizeof(int));
+        ok = counts != NULL;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, MASTER, comm);
+    if (!ok) {
+        return false;
+    }
+
+    MPI_Gather(&local_size, 1, MPI_INT, counts, 1, MPI_INT, MASTER, comm);
+    if (rank == MASTER) {
+        int* offsets = counts + ranks;
+        for (int i = 0; i < ranks; i++) {
+            offsets[i] = (i == 0) ? 0 : offsets[i - 1] + counts[i - 1];
+        }
+        ok = all != NULL || offsets[ranks - 1] + counts[ranks - 1] == 0;
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, MASTER, comm);
+    if (!ok) {
+        return false;
+    }
+    MPI_Gatherv(local, local_size, MPI_INT, all, counts, counts + ranks, MPI_INT, MASTER, comm);
+    return true;
+}
+
+#endif